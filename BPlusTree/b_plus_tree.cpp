@@ -1,18 +1,191 @@
 // b_plus_tree.cpp
 #include "b_plus_tree.h"
 #include <sstream>
+#include <climits>
+#include <thread>
+#include <atomic>
 
-Node::Node(int order, bool is_leaf) : is_leaf(is_leaf), parent(nullptr) {
+Node::Node(int order, bool is_leaf)
+    : is_leaf(is_leaf), parent(nullptr), epoch(0), use_model(false), model_intercept(0.0), model_slope(0.0) {
     min_keys = is_leaf ? std::floor((order + 1) / 2) : std::ceil((order + 1) / 2) - 1;
     max_keys = order;
     num_keys = keys.size();
 }
 
+// First slot whose key does not satisfy precedes(key), given that the keys satisfying it form a
+// prefix. With a model, the search gallops from the predicted slot: doubling steps bracket the
+// answer, then a binary search inside the bracket finds it, so a stale model only costs comparisons.
+template<typename Precedes>
+static int search_slot(const Node* node, int key, Precedes precedes) {
+    const std::vector<int>& keys = node->keys;
+    int n = keys.size();
+    if (!node->use_model) {
+        int lo = 0, hi = n;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (precedes(keys[mid])) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    }
+
+    double predicted = node->model_intercept + node->model_slope * key;
+    int guess = predicted <= 0 ? 0 : predicted >= n ? n : static_cast<int>(predicted + 0.5);
+    int lo, hi, step = 1;
+    if (guess < n && precedes(keys[guess])) {
+        lo = guess + 1;
+        while (lo + step - 1 < n && precedes(keys[lo + step - 1])) {
+            lo += step;
+            step *= 2;
+        }
+        hi = std::min(n, lo + step - 1);
+    } else {
+        hi = guess;
+        while (hi - step >= 0 && !precedes(keys[hi - step])) {
+            hi -= step;
+            step *= 2;
+        }
+        lo = std::max(0, hi - step + 1);
+    }
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (precedes(keys[mid])) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+int Node::lower_slot(int key) const {
+    return search_slot(this, key, [key](int other) { return other < key; });
+}
+
+int Node::upper_slot(int key) const {
+    return search_slot(this, key, [key](int other) { return other <= key; });
+}
+
+// Least-squares fit of slot on key. The model is kept if galloping from its predictions, about
+// 2 log2(error + 1) + 1 comparisons for the mean error, beats binary search's log2(n + 1).
+void Node::fit_model() {
+    int n = keys.size();
+    use_model = false;
+    if (n < 8 || keys.front() == keys.back()) return;
+
+    double mean_key = 0.0, mean_slot = (n - 1) / 2.0;
+    for (int key : keys) {
+        mean_key += key;
+    }
+    mean_key /= n;
+    double covariance = 0.0, variance = 0.0;
+    for (int i = 0; i < n; ++i) {
+        covariance += (keys[i] - mean_key) * (i - mean_slot);
+        variance += (keys[i] - mean_key) * (keys[i] - mean_key);
+    }
+    model_slope = covariance / variance;
+    model_intercept = mean_slot - model_slope * mean_key;
+
+    double error = 0.0;
+    for (int i = 0; i < n; ++i) {
+        error += std::abs(model_intercept + model_slope * keys[i] - i);
+    }
+    error /= n;
+    use_model = 2 * std::log2(error + 1) + 1 < std::log2(n + 1.0);
+}
+
 InternalNode::InternalNode(int order) : Node(order, false) {}
 
 LeafNode::LeafNode(int order) : Node(order, true), next(nullptr) {}
 
-BPlusTree::BPlusTree(int order) : order(order), root(nullptr) {}
+BPlusTree::BPlusTree(int order, bool model_search)
+    : order(order), root(nullptr), model_search(model_search), versions(std::make_shared<VersionState>()), tombstone_count(0), leaves(0),
+      compaction_resume(false), compaction_key(0), compaction_skip(0) {}
+
+template<typename NodeType>
+NodeType* BPlusTree::create_node() {
+    NodeType* node = new NodeType(order);
+    node->epoch = versions->epoch;
+    return node;
+}
+
+bool BPlusTree::shared(Node* node) const {
+    return !versions->pinned.empty() && node->epoch <= *versions->pinned.rbegin();
+}
+
+// Returns a version of node that no snapshot can see, copying it if needed. The copy replaces
+// node in a writable copy of its parent, so the whole path to the root becomes writable and the
+// parent of a writable node is always writable too.
+Node* BPlusTree::writable(Node* node) {
+    if (!shared(node)) return node;
+
+    Node* copy;
+    if (node->is_leaf) {
+        copy = new LeafNode(*static_cast<LeafNode*>(node));
+    } else {
+        InternalNode* internal_copy = new InternalNode(*static_cast<InternalNode*>(node));
+        for (Node* child : internal_copy->pointers) {
+            child->parent = internal_copy;
+        }
+        copy = internal_copy;
+    }
+    copy->epoch = versions->epoch;
+
+    if (node->parent) {
+        InternalNode* parent = static_cast<InternalNode*>(writable(node->parent));
+        *std::find(parent->pointers.begin(), parent->pointers.end(), node) = copy;
+        copy->parent = parent;
+    } else {
+        root = copy;
+    }
+
+    // Snapshots never follow next pointers, so the live chain can be relinked in place.
+    if (copy->is_leaf) {
+        LeafNode* previous = previous_leaf(copy);
+        if (previous) previous->next = static_cast<LeafNode*>(copy);
+    }
+
+    release(node);
+    return copy;
+}
+
+LeafNode* BPlusTree::previous_leaf(Node* node) const {
+    while (node->parent) {
+        InternalNode* parent = static_cast<InternalNode*>(node->parent);
+        int index = std::find(parent->pointers.begin(), parent->pointers.end(), node) - parent->pointers.begin();
+        if (index > 0) {
+            Node* leaf = parent->pointers[index - 1];
+            while (!leaf->is_leaf) {
+                leaf = static_cast<InternalNode*>(leaf)->pointers.back();
+            }
+            return static_cast<LeafNode*>(leaf);
+        }
+        node = parent;
+    }
+    return nullptr;
+}
+
+// Frees a node that left the tree, or retires it until the snapshots that can still reach it are released.
+void BPlusTree::release(Node* node) {
+    if (shared(node)) {
+        versions->retired.push_back(std::make_pair(versions->epoch, node));
+    } else {
+        delete node;
+    }
+}
+
+void BPlusTree::refit(Node* node) {
+    if (model_search) node->fit_model();
+}
+
+// A node retired in epoch e is reachable only from snapshots pinned before e.
+void VersionState::reclaim() {
+    unsigned long long oldest = pinned.empty() ? ULLONG_MAX : *pinned.begin();
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); ++i) {
+        if (retired[i].first <= oldest) {
+            delete retired[i].second;
+        } else {
+            retired[kept++] = retired[i];
+        }
+    }
+    retired.resize(kept);
+}
 
 Node* BPlusTree::find_leaf_node(int key) {
     if (!root) return nullptr;
@@ -20,43 +193,52 @@ Node* BPlusTree::find_leaf_node(int key) {
     Node* node = root;
     while (!node->is_leaf) {
         InternalNode* internal_node = static_cast<InternalNode*>(node);
-        auto it = std::upper_bound(internal_node->keys.begin(), internal_node->keys.end(), key);
-        int index = it - internal_node->keys.begin();
-        node = internal_node->pointers[index];
+        node = internal_node->pointers[internal_node->upper_slot(key)];
     }
 
     return node;
 }
 
 void BPlusTree::insert_into_leaf_node(LeafNode* leaf, int key, int value) {
-    auto it = std::lower_bound(leaf->keys.begin(), leaf->keys.end(), key);
-    int index = it - leaf->keys.begin();
-    leaf->keys.insert(it, key);
+    int index = leaf->lower_slot(key);
+    leaf->keys.insert(leaf->keys.begin() + index, key);
     leaf->values.insert(leaf->values.begin() + index, value);
+    leaf->tombstones.insert(leaf->tombstones.begin() + index, false);
+    leaf->num_keys += 1;
+    refit(leaf);
 }
 
-void BPlusTree::insert_into_internal_node(InternalNode* parent, int key, Node* child) {
-    auto it = std::lower_bound(parent->keys.begin(), parent->keys.end(), key);
-    int index = it - parent->keys.begin();
-    parent->keys.insert(it, key);
+void BPlusTree::insert_into_internal_node(InternalNode* parent, Node* left, int key, Node* child) {
+    // Place the new child right after the node it was split from; searching by key alone
+    // can land on the wrong side of equal separators when the tree holds duplicate keys.
+    int index = std::find(parent->pointers.begin(), parent->pointers.end(), left) - parent->pointers.begin();
+    parent->keys.insert(parent->keys.begin() + index, key);
     parent->pointers.insert(parent->pointers.begin() + index + 1, child);
     child->parent = parent;
+    refit(parent);
 }
 
 void BPlusTree::split_leaf_node(LeafNode* leaf) {
     int mid = order / 2;
-    LeafNode* new_leaf = new LeafNode(order);
+    LeafNode* new_leaf = create_node<LeafNode>();
+    ++leaves;
 
     new_leaf->keys.assign(leaf->keys.begin() + mid, leaf->keys.end());
     new_leaf->values.assign(leaf->values.begin() + mid, leaf->values.end());
+    new_leaf->tombstones.assign(leaf->tombstones.begin() + mid, leaf->tombstones.end());
     leaf->keys.erase(leaf->keys.begin() + mid, leaf->keys.end());
     leaf->values.erase(leaf->values.begin() + mid, leaf->values.end());
+    leaf->tombstones.erase(leaf->tombstones.begin() + mid, leaf->tombstones.end());
+    new_leaf->num_keys = std::count(new_leaf->tombstones.begin(), new_leaf->tombstones.end(), false);
+    leaf->num_keys -= new_leaf->num_keys;
+    refit(leaf);
+    refit(new_leaf);
 
     new_leaf->next = leaf->next;
     leaf->next = new_leaf;
 
     if (!leaf->parent) {
-        InternalNode* new_root = new InternalNode(order);
+        InternalNode* new_root = create_node<InternalNode>();
         root = new_root;
         new_root->keys.push_back(new_leaf->keys[0]);
         new_root->pointers.push_back(leaf);
@@ -66,7 +248,7 @@ void BPlusTree::split_leaf_node(LeafNode* leaf) {
     } else {
         InternalNode* parent = static_cast<InternalNode*>(leaf->parent);
         int new_key = new_leaf->keys[0];
-        insert_into_internal_node(parent, new_key, new_leaf);
+        insert_into_internal_node(parent, leaf, new_key, new_leaf);
 
         while (parent->keys.size() > parent->max_keys) {
             split_internal_node(parent);
@@ -79,28 +261,30 @@ void BPlusTree::split_leaf_node(LeafNode* leaf) {
 
 void BPlusTree::split_internal_node(InternalNode* node) {
     int mid = order / 2;
-    InternalNode* new_node = new InternalNode(order);
+    InternalNode* new_node = create_node<InternalNode>();
+    int new_key = node->keys[mid];
     new_node->keys.assign(node->keys.begin() + mid + 1, node->keys.end());
     new_node->pointers.assign(node->pointers.begin() + mid + 1, node->pointers.end());
     node->keys.erase(node->keys.begin() + mid, node->keys.end());
     node->pointers.erase(node->pointers.begin() + mid + 1, node->pointers.end());
+    refit(node);
+    refit(new_node);
 
     for (Node* child : new_node->pointers) {
         child->parent = new_node;
     }
 
     if (!node->parent) {
-        InternalNode* new_root = new InternalNode(order);
+        InternalNode* new_root = create_node<InternalNode>();
         root = new_root;
-        new_root->keys.push_back(node->keys[mid]);
+        new_root->keys.push_back(new_key);
         new_root->pointers.push_back(node);
         new_root->pointers.push_back(new_node);
         node->parent = new_root;
         new_node->parent = new_root;
     } else {
         InternalNode* parent = static_cast<InternalNode*>(node->parent);
-        int new_key = node->keys[mid];
-        insert_into_internal_node(parent, new_key, new_node);
+        insert_into_internal_node(parent, node, new_key, new_node);
 
         while (parent->keys.size() > parent->max_keys) {
             split_internal_node(parent);
@@ -111,83 +295,103 @@ void BPlusTree::split_internal_node(InternalNode* node) {
     }
 }
 
-void BPlusTree::delete_entry(Node* node, int key) {
-    if (node->is_leaf) {
-        LeafNode* leaf = static_cast<LeafNode*>(node);
-        remove_from_leaf_node(leaf, key);
-    } else {
-        InternalNode* internal_node = static_cast<InternalNode*>(node);
-        remove_from_internal_node(internal_node, key);
-    }
+static bool underfull(const Node* node) {
+    return static_cast<int>(node->keys.size()) < node->min_keys;
+}
+
+static bool can_lend(const Node* node) {
+    return node && static_cast<int>(node->keys.size()) > node->min_keys;
+}
 
-    while (node->parent && node->keys.size() < node->min_keys) {
+// Restores the minimum fill of an underfull node by borrowing from or merging with a sibling,
+// moving up while merges leave the parent underfull. Returns the node that now holds the
+// entries of node (its left sibling if the two were merged).
+Node* BPlusTree::rebalance(Node* node) {
+    Node* survivor = node;
+    while (node->parent && underfull(node)) {
         InternalNode* parent = static_cast<InternalNode*>(node->parent);
-        int index = std::lower_bound(parent->keys.begin(), parent->keys.end(), node->keys[0]) - parent->keys.begin();
+        int index = std::find(parent->pointers.begin(), parent->pointers.end(), node) - parent->pointers.begin();
         Node* left_sibling = index > 0 ? parent->pointers[index - 1] : nullptr;
-        Node* right_sibling = index < parent->keys.size() ? parent->pointers[index + 1] : nullptr;
+        Node* right_sibling = index + 1 < static_cast<int>(parent->pointers.size()) ? parent->pointers[index + 1] : nullptr;
+
+        // Compaction can leave a leaf several entries short, so borrow until node is full enough
+        // or the sibling reaches its own minimum; a sibling at its minimum always fits into a merge.
+        if (can_lend(left_sibling)) {
+            left_sibling = writable(left_sibling);
+            while (underfull(node) && can_lend(left_sibling)) {
+                borrow_key(left_sibling, node, parent, index - 1);
+            }
+        } else if (can_lend(right_sibling)) {
+            right_sibling = writable(right_sibling);
+            while (underfull(node) && can_lend(right_sibling)) {
+                borrow_key(node, right_sibling, parent, index);
+            }
+        }
+        if (!underfull(node)) break;
 
-        if (left_sibling && left_sibling->keys.size() > left_sibling->min_keys) {
-            borrow_key(left_sibling, node, parent, index - 1);
-        } else if (right_sibling && right_sibling->keys.size() > right_sibling->min_keys) {
-            borrow_key(node, right_sibling, parent, index);
-        } else if (left_sibling) {
+        if (left_sibling) {
+            left_sibling = writable(left_sibling);
             merge_nodes(left_sibling, node, parent, index - 1);
-            node = left_sibling;
-        } else {
+            if (survivor == node) survivor = left_sibling;
+        } else if (right_sibling) {
             merge_nodes(node, right_sibling, parent, index);
+        } else {
+            break;
         }
+        node = parent;
     }
 
-    if (root->keys.empty() && !root->is_leaf) {
+    while (!root->is_leaf && root->keys.empty()) {
         InternalNode* old_root = static_cast<InternalNode*>(root);
         root = old_root->pointers[0];
         root->parent = nullptr;
-        delete old_root;
+        release(old_root);
     }
+    return survivor;
 }
 
-//void BPlusTree::remove_from_leaf_node(LeafNode* leaf, int key) {
-//    auto it = std::lower_bound(leaf->keys.begin(), leaf->keys.end(), key);
-//    int index = it - leaf->keys.begin();
-//    leaf->keys.erase(it);
-//    leaf->values.erase(leaf->values.begin() + index);
-//}
-
-void BPlusTree::remove_from_leaf_node(LeafNode* leaf, int key) {
-    int index = 0;
-    while (index < leaf->num_keys && leaf->keys[index] < key) {
-        ++index;
-    }
-
-    if (index < leaf->num_keys && leaf->keys[index] == key) {
-        // Shift keys and values to the left to fill the gap
-        for (int i = index; i < leaf->num_keys - 1; ++i) {
-            leaf->keys[i] = leaf->keys[i + 1];
-            leaf->values[i] = leaf->values[i + 1];
-        }
-        leaf->num_keys -= 1;
-    }
+void BPlusTree::remove_from_leaf_node(LeafNode* leaf, int index) {
+    if (!leaf->tombstones[index]) leaf->num_keys -= 1;
+    leaf->keys.erase(leaf->keys.begin() + index);
+    leaf->values.erase(leaf->values.begin() + index);
+    leaf->tombstones.erase(leaf->tombstones.begin() + index);
+    refit(leaf);
 }
 
-
-
-void BPlusTree::remove_from_internal_node(InternalNode* node, int key) {
-    auto it = std::lower_bound(node->keys.begin(), node->keys.end(), key);
-    int index = it - node->keys.begin();
-    node->keys.erase(it);
+void BPlusTree::remove_from_internal_node(InternalNode* node, int index) {
+    node->keys.erase(node->keys.begin() + index);
     node->pointers.erase(node->pointers.begin() + index + 1);
+    refit(node);
 }
 
+// Moves entry `from` of source to position `to` of target.
+static void move_entry(LeafNode* source, int from, LeafNode* target, int to) {
+    target->keys.insert(target->keys.begin() + to, source->keys[from]);
+    target->values.insert(target->values.begin() + to, source->values[from]);
+    target->tombstones.insert(target->tombstones.begin() + to, source->tombstones[from]);
+    if (!source->tombstones[from]) {
+        source->num_keys -= 1;
+        target->num_keys += 1;
+    }
+    source->keys.erase(source->keys.begin() + from);
+    source->values.erase(source->values.begin() + from);
+    source->tombstones.erase(source->tombstones.begin() + from);
+}
+
+// Moves one entry (or child) between adjacent siblings, toward the one holding fewer keys, and
+// updates their separator parent->keys[index].
 void BPlusTree::borrow_key(Node* left, Node* right, InternalNode* parent, int index) {
+    bool to_left = left->keys.size() < right->keys.size();
     if (left->is_leaf) {
         LeafNode* left_leaf = static_cast<LeafNode*>(left);
         LeafNode* right_leaf = static_cast<LeafNode*>(right);
-        left_leaf->keys.push_back(right_leaf->keys[0]);
-        left_leaf->values.push_back(right_leaf->values[0]);
-        right_leaf->keys.erase(right_leaf->keys.begin());
-        right_leaf->values.erase(right_leaf->values.begin());
+        if (to_left) {
+            move_entry(right_leaf, 0, left_leaf, left_leaf->keys.size());
+        } else {
+            move_entry(left_leaf, left_leaf->keys.size() - 1, right_leaf, 0);
+        }
         parent->keys[index] = right_leaf->keys[0];
-    } else {
+    } else if (to_left) {
         InternalNode* left_internal = static_cast<InternalNode*>(left);
         InternalNode* right_internal = static_cast<InternalNode*>(right);
         left_internal->keys.push_back(parent->keys[index]);
@@ -196,16 +400,32 @@ void BPlusTree::borrow_key(Node* left, Node* right, InternalNode* parent, int in
         parent->keys[index] = right_internal->keys[0];
         right_internal->keys.erase(right_internal->keys.begin());
         right_internal->pointers.erase(right_internal->pointers.begin());
+    } else {
+        InternalNode* left_internal = static_cast<InternalNode*>(left);
+        InternalNode* right_internal = static_cast<InternalNode*>(right);
+        right_internal->keys.insert(right_internal->keys.begin(), parent->keys[index]);
+        right_internal->pointers.insert(right_internal->pointers.begin(), left_internal->pointers.back());
+        left_internal->pointers.back()->parent = right_internal;
+        parent->keys[index] = left_internal->keys.back();
+        left_internal->keys.pop_back();
+        left_internal->pointers.pop_back();
     }
+    refit(left);
+    refit(right);
+    refit(parent);
 }
 
+// Appends right to its left sibling and drops right and their separator parent->keys[index] from parent.
 void BPlusTree::merge_nodes(Node* left, Node* right, InternalNode* parent, int index) {
     if (left->is_leaf) {
         LeafNode* left_leaf = static_cast<LeafNode*>(left);
         LeafNode* right_leaf = static_cast<LeafNode*>(right);
         left_leaf->keys.insert(left_leaf->keys.end(), right_leaf->keys.begin(), right_leaf->keys.end());
         left_leaf->values.insert(left_leaf->values.end(), right_leaf->values.begin(), right_leaf->values.end());
+        left_leaf->tombstones.insert(left_leaf->tombstones.end(), right_leaf->tombstones.begin(), right_leaf->tombstones.end());
+        left_leaf->num_keys += right_leaf->num_keys;
         left_leaf->next = right_leaf->next;
+        --leaves;
     } else {
         InternalNode* left_internal = static_cast<InternalNode*>(left);
         InternalNode* right_internal = static_cast<InternalNode*>(right);
@@ -218,16 +438,37 @@ void BPlusTree::merge_nodes(Node* left, Node* right, InternalNode* parent, int i
         }
     }
 
-    delete_entry(parent, parent->keys[index]);
-    delete right;
+    refit(left);
+    remove_from_internal_node(parent, index);
+    release(right);
+}
+
+LeafNode* BPlusTree::find_first_leaf(int key) const {
+    // Descend to the leftmost leaf that can hold key: equal keys may sit on both sides of a separator.
+    Node* node = root;
+    while (!node->is_leaf) {
+        InternalNode* internal_node = static_cast<InternalNode*>(node);
+        node = internal_node->pointers[internal_node->lower_slot(key)];
+    }
+    return static_cast<LeafNode*>(node);
+}
+
+LeafNode* BPlusTree::find_live_entry(int key, int& index) const {
+    LeafCursor cursor = lower_bound(key);
+    if (!cursor.valid() || cursor.key() != key) return nullptr;
+    index = cursor.index;
+    return cursor.leaf;
 }
 
 void BPlusTree::insert(int key, int value) {
+    std::lock_guard<std::mutex> lock(versions->mutex);
     Node* leaf = find_leaf_node(key);
     if (!leaf) {
-        root = new LeafNode(order);
+        root = create_node<LeafNode>();
         leaf = root;
+        ++leaves;
     }
+    leaf = writable(leaf);
 
     insert_into_leaf_node(static_cast<LeafNode*>(leaf), key, value);
 
@@ -237,34 +478,97 @@ void BPlusTree::insert(int key, int value) {
 }
 
 void BPlusTree::remove(int key) {
-    Node* node = find_leaf_node(key);
-    if (!node) return;
+    std::lock_guard<std::mutex> lock(versions->mutex);
+    int index;
+    LeafNode* leaf = find_live_entry(key, index);
+    if (!leaf) return;
+
+    leaf = static_cast<LeafNode*>(writable(leaf));
+    remove_from_leaf_node(leaf, index);
+    rebalance(leaf);
+}
 
-    delete_entry(node, key);
+bool BPlusTree::mark_deleted(int key) {
+    std::lock_guard<std::mutex> lock(versions->mutex);
+    int index;
+    LeafNode* leaf = find_live_entry(key, index);
+    if (!leaf) return false;
+
+    leaf = static_cast<LeafNode*>(writable(leaf));
+    leaf->tombstones[index] = true;
+    leaf->num_keys -= 1;
+    ++tombstone_count;
+    return true;
 }
 
-int BPlusTree::search(int key) {
-    Node* leaf = find_leaf_node(key);
-    if (!leaf) return -1;
+int BPlusTree::compact(int budget) {
+    std::lock_guard<std::mutex> lock(versions->mutex);
+    if (!root || tombstone_count == 0) return 0;
+
+    // The position is kept as the first key of the next leaf plus the number of leaves to step
+    // over from the leftmost leaf that can hold it, for runs of equal keys spanning leaves. It is
+    // only a hint: if the tree changed in between, skipped leaves are handled on the next pass.
+    LeafNode* leaf = find_first_leaf(compaction_resume ? compaction_key : INT_MIN);
+    for (int i = 0; compaction_resume && i < compaction_skip && leaf->next; ++i) {
+        leaf = leaf->next;
+    }
+
+    int purged = 0;
+    for (int visited = 0; leaf && visited < budget && tombstone_count > 0; ++visited) {
+        if (leaf->num_keys < static_cast<int>(leaf->keys.size())) {
+            leaf = static_cast<LeafNode*>(writable(leaf));
+            int kept = 0;
+            for (size_t i = 0; i < leaf->keys.size(); ++i) {
+                if (leaf->tombstones[i]) continue;
+                leaf->keys[kept] = leaf->keys[i];
+                leaf->values[kept] = leaf->values[i];
+                ++kept;
+            }
+            purged += leaf->keys.size() - kept;
+            tombstone_count -= leaf->keys.size() - kept;
+            leaf->keys.resize(kept);
+            leaf->values.resize(kept);
+            leaf->tombstones.assign(kept, false);
+            refit(leaf);
+            leaf = static_cast<LeafNode*>(rebalance(leaf));
+            // Borrowing or merging may have brought in a sibling's tombstones.
+            if (leaf->num_keys < static_cast<int>(leaf->keys.size())) continue;
+        }
+        leaf = leaf->next;
+    }
 
-    LeafNode* leaf_node = static_cast<LeafNode*>(leaf);
-    auto it = std::lower_bound(leaf_node->keys.begin(), leaf_node->keys.end(), key);
-    if (it == leaf_node->keys.end() || *it != key) {
-        return -1;
+    compaction_resume = leaf && !leaf->keys.empty();
+    if (compaction_resume) {
+        compaction_key = leaf->keys[0];
+        compaction_skip = 0;
+        for (LeafNode* first = find_first_leaf(compaction_key); first && first != leaf; first = first->next) {
+            ++compaction_skip;
+        }
     }
+    return purged;
+}
 
-    int index = it - leaf_node->keys.begin();
-    return leaf_node->values[index];
+int BPlusTree::pending_tombstones() {
+    std::lock_guard<std::mutex> lock(versions->mutex);
+    return tombstone_count;
+}
+
+int BPlusTree::search(int key) {
+    int index;
+    LeafNode* leaf = find_live_entry(key, index);
+    if (!leaf) return -1;
+
+    return leaf->values[index];
 }
 
 std::vector<int> BPlusTree::range_search(int start, int end) {
     std::vector<int> result;
-    Node* leaf = find_leaf_node(start);
-    if (!leaf) return result;
+    if (!root) return result;
 
-    LeafNode* leaf_node = static_cast<LeafNode*>(leaf);
+    LeafNode* leaf_node = find_first_leaf(start);
     while (leaf_node) {
         for (size_t i = 0; i < leaf_node->keys.size(); ++i) {
+            if (leaf_node->tombstones[i]) continue;
             if (leaf_node->keys[i] >= start && leaf_node->keys[i] <= end) {
                 result.push_back(leaf_node->values[i]);
             } else if (leaf_node->keys[i] > end) {
@@ -277,6 +581,252 @@ std::vector<int> BPlusTree::range_search(int start, int end) {
     return result;
 }
 
+LeafCursor::LeafCursor(LeafNode* leaf, int index) : leaf(leaf), index(index), visited(leaf ? 1 : 0) {
+    skip_to_live_entry();
+}
+
+bool LeafCursor::valid() const {
+    return leaf != nullptr;
+}
+
+int LeafCursor::key() const {
+    return leaf->keys[index];
+}
+
+int LeafCursor::value() const {
+    return leaf->values[index];
+}
+
+void LeafCursor::next() {
+    ++index;
+    skip_to_live_entry();
+}
+
+bool LeafCursor::seek(int key, int max_leaves) {
+    LeafNode* target = leaf;
+    int steps = 0;
+    while (target && (target->keys.empty() || target->keys.back() < key)) {
+        if (steps == max_leaves) return false;
+        target = target->next;
+        if (target) ++steps;
+    }
+
+    int start = target == leaf ? index : 0;
+    if (target) {
+        auto it = std::lower_bound(target->keys.begin() + start, target->keys.end(), key);
+        index = it - target->keys.begin();
+    }
+    leaf = target;
+    visited += steps;
+    skip_to_live_entry();
+    return true;
+}
+
+int LeafCursor::leaves_visited() const {
+    return visited;
+}
+
+void LeafCursor::skip_to_live_entry() {
+    while (leaf) {
+        if (index >= static_cast<int>(leaf->keys.size())) {
+            leaf = leaf->next;
+            index = 0;
+            if (leaf) ++visited;
+        } else if (leaf->tombstones[index]) {
+            ++index;
+        } else {
+            break;
+        }
+    }
+}
+
+LeafCursor BPlusTree::begin() const {
+    if (!root) return LeafCursor();
+
+    Node* node = root;
+    while (!node->is_leaf) {
+        node = static_cast<InternalNode*>(node)->pointers[0];
+    }
+    return LeafCursor(static_cast<LeafNode*>(node), 0);
+}
+
+LeafCursor BPlusTree::lower_bound(int key) const {
+    if (!root) return LeafCursor();
+
+    LeafNode* leaf = find_first_leaf(key);
+    return LeafCursor(leaf, leaf->lower_slot(key));
+}
+
+int BPlusTree::height() const {
+    int levels = 0;
+    for (Node* node = root; node; node = node->is_leaf ? nullptr : static_cast<InternalNode*>(node)->pointers[0]) {
+        ++levels;
+    }
+    return levels;
+}
+
+int BPlusTree::leaf_count() const {
+    return leaves;
+}
+
+std::unique_ptr<TreeSnapshot> BPlusTree::snapshot() {
+    std::lock_guard<std::mutex> lock(versions->mutex);
+    unsigned long long epoch = versions->epoch++;
+    versions->pinned.insert(epoch);
+    return std::unique_ptr<TreeSnapshot>(new TreeSnapshot(versions, root, epoch));
+}
+
+size_t BPlusTree::retired_nodes() {
+    std::lock_guard<std::mutex> lock(versions->mutex);
+    return versions->retired.size();
+}
+
+TreeSnapshot::TreeSnapshot(std::shared_ptr<VersionState> versions, Node* root, unsigned long long epoch)
+    : versions(versions), root(root), pinned_epoch(epoch) {}
+
+TreeSnapshot::~TreeSnapshot() {
+    std::lock_guard<std::mutex> lock(versions->mutex);
+    versions->pinned.erase(versions->pinned.find(pinned_epoch));
+    versions->reclaim();
+}
+
+unsigned long long TreeSnapshot::epoch() const {
+    return pinned_epoch;
+}
+
+int TreeSnapshot::search(int key) const {
+    std::vector<int> values = range_search(key, key);
+    return values.empty() ? -1 : values.front();
+}
+
+std::vector<int> TreeSnapshot::range_search(int start_key, int end_key) const {
+    std::vector<int> result;
+    if (!root) return result;
+
+    // The path holds each internal node above the current leaf and the child taken in it;
+    // the next leaf is the leftmost one under the nearest ancestor with a child to the right.
+    std::vector<std::pair<InternalNode*, size_t>> path;
+    Node* node = root;
+    while (!node->is_leaf) {
+        InternalNode* internal_node = static_cast<InternalNode*>(node);
+        size_t index = internal_node->lower_slot(start_key);
+        path.push_back(std::make_pair(internal_node, index));
+        node = internal_node->pointers[index];
+    }
+
+    while (true) {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        size_t i = leaf->lower_slot(start_key);
+        for (; i < leaf->keys.size(); ++i) {
+            if (leaf->keys[i] > end_key) return result;
+            if (!leaf->tombstones[i]) result.push_back(leaf->values[i]);
+        }
+
+        while (!path.empty() && path.back().second + 1 == path.back().first->pointers.size()) {
+            path.pop_back();
+        }
+        if (path.empty()) return result;
+
+        node = path.back().first->pointers[++path.back().second];
+        while (!node->is_leaf) {
+            path.push_back(std::make_pair(static_cast<InternalNode*>(node), size_t(0)));
+            node = static_cast<InternalNode*>(node)->pointers[0];
+        }
+    }
+}
+
+void ScanAggregate::add(int value) {
+    ++count;
+    sum += value;
+    min = std::min(min, value);
+    max = std::max(max, value);
+}
+
+void ScanAggregate::merge(const ScanAggregate& other) {
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+// Child i holds keys between separators i - 1 and i, both inclusive since equal keys may sit
+// on either side of a separator.
+static bool child_overlaps(const InternalNode* node, size_t i, int start_key, int end_key) {
+    return (i == 0 || node->keys[i - 1] <= end_key) && (i == node->keys.size() || node->keys[i] >= start_key);
+}
+
+static void aggregate_subtree(const Node* node, int start_key, int end_key, const ScanFilter& filter, ScanAggregate& result) {
+    if (!node->is_leaf) {
+        const InternalNode* internal_node = static_cast<const InternalNode*>(node);
+        for (size_t i = 0; i < internal_node->pointers.size(); ++i) {
+            if (child_overlaps(internal_node, i, start_key, end_key)) {
+                aggregate_subtree(internal_node->pointers[i], start_key, end_key, filter, result);
+            }
+        }
+        return;
+    }
+
+    const LeafNode* leaf = static_cast<const LeafNode*>(node);
+    size_t i = leaf->lower_slot(start_key);
+    for (; i < leaf->keys.size() && leaf->keys[i] <= end_key; ++i) {
+        if (leaf->tombstones[i]) continue;
+        if (filter && !filter(leaf->keys[i], leaf->values[i])) continue;
+        result.add(leaf->values[i]);
+    }
+}
+
+ScanAggregate TreeSnapshot::parallel_aggregate(int start_key, int end_key, const ScanFilter& filter, unsigned threads) const {
+    ScanAggregate result;
+    if (!root || start_key > end_key) return result;
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Subtrees on one level hold about the same number of entries, so descend until there are
+    // a few per worker, keeping only those that overlap the range.
+    std::vector<const Node*> subtrees(1, root);
+    while (subtrees.size() < 4 * threads && !subtrees[0]->is_leaf) {
+        std::vector<const Node*> children;
+        for (const Node* node : subtrees) {
+            const InternalNode* internal_node = static_cast<const InternalNode*>(node);
+            for (size_t i = 0; i < internal_node->pointers.size(); ++i) {
+                if (child_overlaps(internal_node, i, start_key, end_key)) {
+                    children.push_back(internal_node->pointers[i]);
+                }
+            }
+        }
+        subtrees.swap(children);
+    }
+
+    threads = std::min<size_t>(threads, subtrees.size());
+    std::vector<ScanAggregate> partial(threads);
+    std::atomic<size_t> next_subtree(0);
+    auto worker = [&](unsigned id) {
+        ScanAggregate local;
+        for (size_t i = next_subtree++; i < subtrees.size(); i = next_subtree++) {
+            aggregate_subtree(subtrees[i], start_key, end_key, filter, local);
+        }
+        partial[id] = local;
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned id = 1; id < threads; ++id) {
+        workers.emplace_back(worker, id);
+    }
+    worker(0);
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    for (const ScanAggregate& part : partial) {
+        result.merge(part);
+    }
+    return result;
+}
+
+ScanAggregate BPlusTree::parallel_aggregate(int start_key, int end_key, const ScanFilter& filter, unsigned threads) {
+    return snapshot()->parallel_aggregate(start_key, end_key, filter, threads);
+}
+
 void BPlusTree::print_tree() const {
     if (root == nullptr) {
         std::cout << "The tree is empty." << std::endl;
@@ -7,17 +7,38 @@
 #include <cmath>
 #include <string>
 #include <queue>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <functional>
+#include <climits>
 
 class Node {
 public:
     bool is_leaf;
     int min_keys;
     int max_keys;
+    // Entries that are not tombstones; maintained for leaves.
     int num_keys;
     std::vector<int> keys;
     Node* parent;
+    // Epoch in which this version of the node was created; snapshots pinned at or after it may share it.
+    unsigned long long epoch;
+    // Linear model for slot search: the slot of key is predicted as model_intercept + model_slope * key.
+    // Only used where fit_model() found it cheaper than binary search.
+    bool use_model;
+    double model_intercept;
+    double model_slope;
 
     Node(int order, bool is_leaf);
+    virtual ~Node() = default;
+
+    // Same results as std::lower_bound / std::upper_bound over keys, as an index.
+    int lower_slot(int key) const;
+    int upper_slot(int key) const;
+    void fit_model();
 };
 
 class InternalNode : public Node {
@@ -30,24 +51,114 @@ public:
 class LeafNode : public Node {
 public:
     std::vector<int> values;
+    // Entries deleted lazily by mark_deleted; readers skip them until compact() purges them.
+    std::vector<bool> tombstones;
     LeafNode* next;
 
     LeafNode(int order);
 };
 
+// Position in the leaf chain. Walks the tree's live entries in ascending key order.
+class LeafCursor {
+public:
+    LeafCursor(LeafNode* leaf = nullptr, int index = 0);
+
+    bool valid() const;
+    int key() const;
+    int value() const;
+    void next();
+    // Moves forward to the first entry with a key >= key, following at most max_leaves
+    // next pointers. Returns false (cursor unchanged) if that is not enough.
+    bool seek(int key, int max_leaves);
+    int leaves_visited() const;
+
+private:
+    friend class BPlusTree;
+    LeafNode* leaf;
+    int index;
+    int visited;
+
+    void skip_to_live_entry();
+};
+
+// Copy-on-write bookkeeping shared by a tree and its snapshots. Writers never modify a node
+// that a pinned snapshot can reach: they copy it (and its ancestors) first and retire the old
+// version, which is freed once every snapshot older than its retirement has been released.
+struct VersionState {
+    std::mutex mutex;
+    unsigned long long epoch = 0;
+    std::multiset<unsigned long long> pinned;
+    std::vector<std::pair<unsigned long long, Node*>> retired;
+
+    void reclaim();
+};
+
+// Count, sum, min and max of the values a scan accepted. Scans update it inside the leaf loop,
+// so no values are materialized; per-thread results are merged at the end.
+struct ScanAggregate {
+    long long count = 0;
+    long long sum = 0;
+    int min = INT_MAX;
+    int max = INT_MIN;
+
+    void add(int value);
+    void merge(const ScanAggregate& other);
+};
+
+// Predicate on (key, value) pushed down into a scan; an empty filter accepts every entry.
+typedef std::function<bool(int key, int value)> ScanFilter;
+
+// Read-only view of a tree as of the moment it was taken. Scans descend from the snapshot's root
+// and never follow LeafNode::next, so they can run on another thread while writers proceed.
+// Releasing the snapshot (destroying it) lets the tree reclaim the versions only it could see.
+class TreeSnapshot {
+public:
+    ~TreeSnapshot();
+    TreeSnapshot(const TreeSnapshot&) = delete;
+    TreeSnapshot& operator=(const TreeSnapshot&) = delete;
+
+    int search(int key) const;
+    std::vector<int> range_search(int start_key, int end_key) const;
+    // Aggregates the live entries with keys in [start_key, end_key] that pass filter. The range
+    // is split into the subtrees of the shallowest level with several of them per thread, and
+    // up to `threads` workers (0: one per core) take subtrees until none are left.
+    ScanAggregate parallel_aggregate(int start_key, int end_key, const ScanFilter& filter = ScanFilter(),
+                                     unsigned threads = 0) const;
+    unsigned long long epoch() const;
+
+private:
+    friend class BPlusTree;
+    TreeSnapshot(std::shared_ptr<VersionState> versions, Node* root, unsigned long long epoch);
+
+    std::shared_ptr<VersionState> versions;
+    Node* root;
+    unsigned long long pinned_epoch;
+};
+
 class BPlusTree {
 private:
     int order;
     Node* root;
+    bool model_search;
+    std::shared_ptr<VersionState> versions;
+    int tombstone_count;
+    // Kept by insert, split_leaf_node and merge_nodes so that leaf_count() needs no walk.
+    int leaves;
+    // Where the next compact() call resumes; see compact().
+    bool compaction_resume;
+    int compaction_key;
+    int compaction_skip;
 
     Node* find_leaf_node(int key);
+    LeafNode* find_first_leaf(int key) const;
+    LeafNode* find_live_entry(int key, int& index) const;
     void insert_into_leaf_node(LeafNode* leaf, int key, int value);
-    void insert_into_internal_node(InternalNode* parent, int key, Node* child);
+    void insert_into_internal_node(InternalNode* parent, Node* left, int key, Node* child);
     void split_leaf_node(LeafNode* leaf);
     void split_internal_node(InternalNode* node);
-    void delete_entry(Node* node, int key);
-    void remove_from_leaf_node(LeafNode* leaf, int key);
-    void remove_from_internal_node(InternalNode* node, int key);
+    Node* rebalance(Node* node);
+    void remove_from_leaf_node(LeafNode* leaf, int index);
+    void remove_from_internal_node(InternalNode* node, int index);
 //    void borrow_key(Node* left, Node* right, Node* parent, int left_index);
 //    void merge_nodes(Node* left, Node* right, Node* parent, int left_index);
     
@@ -56,15 +167,51 @@ private:
 //    void print_tree_recursively(Node* node, int level) const;
     void print_tree_recursively(Node* node, int level, std::vector<std::string>& tree_lines) const;
 
+    template<typename NodeType> NodeType* create_node();
+    bool shared(Node* node) const;
+    Node* writable(Node* node);
+    LeafNode* previous_leaf(Node* node) const;
+    void release(Node* node);
+    void refit(Node* node);
+
 
 public:
-    BPlusTree(int order);
+    // With model_search, every node fits a least-squares line from its keys to their slots whenever
+    // a write changes them, and searches in nodes where the line beats binary search start from its prediction.
+    BPlusTree(int order, bool model_search = false);
 
+    // search, range_search and the cursors below read the live tree without locking, so they must
+    // not run while a write or a compaction step is in progress; reads alongside writers go
+    // through snapshot().
     int search(int key);
     std::vector<int> range_search(int start_key, int end_key);
     void insert(int key, int value);
     void remove(int key);
+    // Lazy deletion: marks the first live entry for key as a tombstone and leaves the structure
+    // alone, so underfull leaves are tolerated until compaction. Returns false if key is absent.
+    bool mark_deleted(int key);
+    // Incremental compaction: visits at most budget leaves, resuming where the previous call
+    // stopped, purges their tombstones and rebalances leaves left underfull. Returns the number
+    // of entries purged. Meant to be called periodically; it is serialized with the other writers
+    // and with taking snapshots, so it may run on a background thread as long as concurrent
+    // readers use snapshots.
+    int compact(int budget);
+    int pending_tombstones();
     void print_tree() const;
+
+    LeafCursor begin() const;
+    LeafCursor lower_bound(int key) const;
+    int height() const;
+    // Number of leaves, in constant time.
+    int leaf_count() const;
+
+    // Pins the current version of the tree. Inserts and removes may run concurrently with scans
+    // of the snapshot; they are serialized with each other and with taking snapshots.
+    std::unique_ptr<TreeSnapshot> snapshot();
+    // TreeSnapshot::parallel_aggregate on a snapshot pinned for the duration of the scan.
+    ScanAggregate parallel_aggregate(int start_key, int end_key, const ScanFilter& filter = ScanFilter(),
+                                     unsigned threads = 0);
+    size_t retired_nodes();
 };
 
 #endif
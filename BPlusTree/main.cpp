@@ -1,10 +1,11 @@
 #include <iostream>
 #include <random>
 #include <algorithm>
+#include <chrono>
 #include "b_plus_tree.h"
 
 // RUN THIS IN TERMINAL TO COMPILE:
-// g++ -std=c++11 -o main main.cpp b_plus_tree.cpp
+// g++ -std=c++11 -pthread -o main main.cpp b_plus_tree.cpp
 
 
 //This code is a comprehensive project that explores the performance of B+ trees with different orders and densities under various operations. A B+ tree is a balanced tree data structure commonly used in databases and file systems for efficient search, insertion, and deletion operations.
@@ -29,7 +30,7 @@
 //
 //4. `perform_experiments(int num_records, int min_key, int max_key, int dense_order, int sparse_order)`: This function orchestrates the entire experiment by generating records, building B+ trees with different orders and densities, and performing operations on these trees. It first generates the random records and builds the dense and sparse trees with the given dense_order and sparse_order. Then, it performs operations on both sets of trees (dense and sparse) and prints the tree structures.
 //
-//5. `main()`: The main function initializes the parameters for the experiment and calls `perform_experiments()` to execute the experiment. It also demonstrates a simple example of a B+ tree with order 3 and a predefined set of records, printing the tree structure after inserting the records using the `print_tree_disp` function.
+//5. `main()`: The main function initializes the parameters for the experiment and calls `perform_experiments()` to execute the experiment. It also demonstrates a simple example of a B+ tree with order 3 and a predefined set of records, printing the tree structure after inserting the records using the `print_tree_disp` function, and then pins a snapshot of that tree with `snapshot()`, inserts more keys and compares a range scan of the snapshot with one of the live tree. It then deletes keys lazily with `mark_deleted()` and purges the tombstones with small `compact()` steps. It aggregates a million keys with `parallel_aggregate()`, once over the whole range and once with a filter. Finally it times a million lookups of uniformly distributed keys in a tree using binary search and in one built with `model_search`, where each node predicts the slot of a key from a least-squares line fitted to its keys and their slots, and uses it only where its mean error makes a galloping search cheaper than binary search.
 //
 //In summary, this code tests the functionality and efficiency of B+ trees with different orders and densities by performing a series of insertions, deletions, and searches while printing the tree structure after each operation. The experiment aims to help understand how B+ trees behave under different configurations and tree densities, which can be beneficial in optimizing the performance of databases and file systems that use B+ trees.
 
@@ -175,6 +176,60 @@ int main() {
     std::cout << "SIMPLE EXP DONE!" << std::endl;
     std::cout << "---------------------------" << std::endl;
     std::cout << std::endl;
+
+    std::cout << "SNAPSHOT EXP: " << std::endl;
+    std::unique_ptr<TreeSnapshot> snapshot = tree1.snapshot();
+    for (int key = 61; key <= 70; ++key) {
+        tree1.insert(key, key);
+    }
+    std::cout << "Keys in [20, 100] at the snapshot: " << snapshot->range_search(20, 100).size() << std::endl;
+    std::cout << "Keys in [20, 100] now: " << tree1.range_search(20, 100).size() << std::endl;
+    std::cout << "Node versions kept for the snapshot: " << tree1.retired_nodes() << std::endl;
+    snapshot.reset();
+    std::cout << "After releasing it: " << tree1.retired_nodes() << std::endl;
+    std::cout << "---------------------------" << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "TOMBSTONE EXP: " << std::endl;
+    for (int key : {3, 5, 7, 9, 11, 13, 15, 18}) {
+        tree1.mark_deleted(key);
+    }
+    std::cout << "Tombstones: " << tree1.pending_tombstones() << ", keys in [0, 20]: " << tree1.range_search(0, 20).size() << std::endl;
+    while (tree1.pending_tombstones() > 0) {
+        std::cout << "Compaction step purged " << tree1.compact(2) << std::endl;
+    }
+    print_tree_disp(tree1);
+    std::cout << std::endl;
+
+    std::cout << "PARALLEL SCAN EXP: " << std::endl;
+    BPlusTree scan_tree(64);
+    for (int key = 0; key < 1000000; ++key) {
+        scan_tree.insert(key, key % 1000);
+    }
+    ScanAggregate all = scan_tree.parallel_aggregate(0, 999999);
+    ScanAggregate even = scan_tree.parallel_aggregate(250000, 749999, [](int key, int value) { return key % 2 == 0; });
+    std::cout << "All keys: count " << all.count << ", sum " << all.sum << ", min " << all.min << ", max " << all.max << std::endl;
+    std::cout << "Even keys in [250000, 749999]: count " << even.count << ", sum " << even.sum << std::endl;
+    std::cout << "---------------------------" << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "MODEL SEARCH EXP: " << std::endl;
+    std::vector<int> uniform_keys = generate_records(1000000, 0, 100000000);
+    for (bool model_search : {false, true}) {
+        BPlusTree lookup_tree(128, model_search);
+        for (const int& key : uniform_keys) {
+            lookup_tree.insert(key, key);
+        }
+        auto start = std::chrono::steady_clock::now();
+        long long found = 0;
+        for (const int& key : uniform_keys) {
+            found += lookup_tree.search(key) == key;
+        }
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (model_search ? "Model-assisted" : "Binary") << " search: " << found << " keys found in " << millis << " ms" << std::endl;
+    }
+    std::cout << "---------------------------" << std::endl;
+    std::cout << std::endl;
     
     int num_records = 10000;
     int min_key = 100000;
@@ -0,0 +1,273 @@
+// hash_aggregation.h
+#ifndef HASH_AGGREGATION_H
+#define HASH_AGGREGATION_H
+
+#include <type_traits>
+#include "hashing_based_join.h"
+
+// Hash aggregation (GROUP BY B with count, sum, min and max of C) on the partitioning and block I/O
+// of twoPassJoin, and an aggregate join that groups R(A, B) ⋈ S(B, C) by B without materializing
+// the join. Partial aggregates are merged inside the memory block of their partition before it is
+// written, so a partition spills at most one record per distinct B-value per block.
+
+// Part 1: Partial Aggregates
+
+// Sums of integer C values are widened to long long, sums of floating point ones to double.
+template<typename T>
+using AggregateSum = typename std::conditional<std::is_floating_point<T>::value, double, long long>::type;
+
+// count, sum, min and max of the C values of one B-value. Doubles as the partial aggregate that
+// Phase 1 writes to the virtual disk.
+template<typename T>
+struct GroupAggregate {
+    int B = 0;
+    long long count = 0;
+    AggregateSum<T> sum = 0;
+    T min = T();
+    T max = T();
+
+    void add(const T& value) {
+        if (count == 0 || value < min) min = value;
+        if (count == 0 || max < value) max = value;
+        sum += value;
+        count++;
+    }
+
+    void merge(const GroupAggregate& other) {
+        if (other.count == 0) return;
+        if (count == 0 || other.min < min) min = other.min;
+        if (count == 0 || max < other.max) max = other.max;
+        sum += other.sum;
+        count += other.count;
+    }
+};
+
+template<typename T>
+long long tupleBytes(const GroupAggregate<T>&) {
+    return sizeof(GroupAggregate<T>);
+}
+
+template<typename T>
+GroupAggregate<T> partialAggregate(const Tuple<T>& tuple) {
+    GroupAggregate<T> partial;
+    partial.B = tuple.B;
+    partial.add(tuple.C);
+    return partial;
+}
+
+// Adds a partial aggregate to its partition, merging it into a record of the same B-value that is
+// still in the partition's memory block.
+template<typename T>
+void addPartial(Partitioner<GroupAggregate<T>>& partitioner, const GroupAggregate<T>& partial) {
+    for (auto& record : partitioner.block(partial.B)) {
+        if (record.B == partial.B) {
+            record.merge(partial);
+            return;
+        }
+    }
+    partitioner.add(partial);
+}
+
+template<typename T>
+void mergeInto(std::unordered_map<int, GroupAggregate<T>>& groups, const GroupAggregate<T>& partial) {
+    auto inserted = groups.emplace(partial.B, partial);
+    if (!inserted.second) {
+        inserted.first->second.merge(partial);
+    }
+}
+
+template<typename T>
+void sortGroups(std::vector<GroupAggregate<T>>& groups) {
+    std::sort(groups.begin(), groups.end(),
+              [](const GroupAggregate<T>& a, const GroupAggregate<T>& b) { return a.B < b.B; });
+}
+
+inline void addPhase(PhaseStats& total, const PhaseStats& phase) {
+    total.blocksRead += phase.blocksRead;
+    total.blocksWritten += phase.blocksWritten;
+    total.bytesRead += phase.bytesRead;
+    total.bytesWritten += phase.bytesWritten;
+    total.wallMillis += phase.wallMillis;
+}
+
+// Part 2: Aggregation
+
+// SELECT B, COUNT(C), SUM(C), MIN(C), MAX(C) FROM relation GROUP BY B, sorted on B. A relation that
+// fits in memory is aggregated in one pass; otherwise Phase 1 partitions it on B (merging partial
+// aggregates in memory) and Phase 2 reads each partition back and finishes its groups. The profile
+// uses `partitionSizesR` for the partitions and `outputTuples` for the number of groups.
+template<typename T>
+std::vector<GroupAggregate<T>> hashAggregate(const std::vector<Tuple<T>>& relation, JoinProfile& profile) {
+    static_assert(std::is_arithmetic<T>::value, "hashAggregate needs an arithmetic C");
+    profile = JoinProfile();
+    std::vector<GroupAggregate<T>> output;
+    if (static_cast<int>(relation.size()) <= MEMORY_BLOCKS * BLOCK_SIZE) {
+        auto start = std::chrono::steady_clock::now();
+        profile.onePass = true;
+        std::unordered_map<int, GroupAggregate<T>> groups;
+        for (const auto& tuple : relation) {
+            mergeInto(groups, partialAggregate(tuple));
+        }
+        for (const auto& group : groups) {
+            output.push_back(group.second);
+        }
+        profile.outputTuples = output.size();
+        profile.join.wallMillis = elapsedMillis(start);
+        sortGroups(output);
+        return output;
+    }
+
+    // Phase 1: Partitioning
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<GroupAggregate<T>>> diskHashTable(MEMORY_BLOCKS);
+    Partitioner<GroupAggregate<T>> partitioner(diskHashTable, profile.partitioning);
+    for (const auto& tuple : relation) {
+        addPartial(partitioner, partialAggregate(tuple));
+    }
+    partitioner.flushAll();
+    profile.partitioning.wallMillis = elapsedMillis(start);
+
+    // Phase 2: Aggregation
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MEMORY_BLOCKS; ++i) {
+        profile.partitionSizesR.push_back(diskHashTable[i].size());
+
+        std::vector<GroupAggregate<T>> partition;
+        loadPartition(diskHashTable[i], partition, profile.join);
+        std::unordered_map<int, GroupAggregate<T>> groups;
+        for (const auto& partial : partition) {
+            mergeInto(groups, partial);
+        }
+        profile.loadFactors.push_back(groups.load_factor());
+        for (const auto& group : groups) {
+            output.push_back(group.second);
+        }
+    }
+    profile.join.wallMillis = elapsedMillis(start);
+    profile.outputTuples = output.size();
+    sortGroups(output);
+    return output;
+}
+
+// Part 3: Aggregate Join
+
+// The aggregates of S.C over the join R(A, B) ⋈ S(B, C), grouped by B: every S tuple of a B-value
+// joins with each of the r R tuples of that value, so the group of the join is the S group with its
+// count and sum scaled by r.
+template<typename T>
+GroupAggregate<T> joinGroup(long long countR, const GroupAggregate<T>& groupS) {
+    GroupAggregate<T> group = groupS;
+    group.count *= countR;
+    group.sum *= countR;
+    return group;
+}
+
+// SELECT B, COUNT(C), SUM(C), MIN(C), MAX(C) FROM R ⋈ S GROUP BY B, sorted on B.
+//
+// With `eager` set, both sides are aggregated before the join: S is partitioned as partial
+// aggregates of C and R, which only contributes a count per B-value, as partial counts, after the
+// Bloom filter on S.B has dropped the R tuples without a partner. Phase 2 joins one group per
+// B-value on each side, so its work and output grow with the number of distinct B-values instead of
+// the number of matches. Without `eager`, the join is materialized by twoPassJoin and then grouped
+// by hashAggregate, with both operators' I/O added to the profile.
+template<typename T>
+std::vector<GroupAggregate<T>> aggregateJoin(std::vector<Tuple<T>>& R, std::vector<Tuple<T>>& S, JoinProfile& profile, bool eager = true) {
+    static_assert(std::is_arithmetic<T>::value, "aggregateJoin needs an arithmetic C");
+    std::vector<GroupAggregate<T>> output;
+
+    if (!eager) {
+        std::vector<Tuple<T>> joined = twoPassJoin(R, S, profile);
+        JoinProfile aggregation;
+        output = hashAggregate(joined, aggregation);
+        addPhase(profile.partitioning, aggregation.partitioning);
+        addPhase(profile.join, aggregation.join);
+        profile.outputTuples = output.size();
+        return output;
+    }
+
+    profile = JoinProfile();
+    auto partialR = [](const Tuple<T>& tuple) {
+        GroupAggregate<T> partial;
+        partial.B = tuple.B;
+        partial.count = 1;
+        return partial;
+    };
+    auto joinGroups = [&](const std::unordered_map<int, GroupAggregate<T>>& groupsR,
+                          const std::unordered_map<int, GroupAggregate<T>>& groupsS) {
+        profile.loadFactors.push_back(groupsS.load_factor());
+        for (const auto& group : groupsR) {
+            profile.probes += group.second.count;
+            auto match = groupsS.find(group.first);
+            if (match != groupsS.end()) {
+                profile.probeHits += group.second.count;
+                output.push_back(joinGroup(group.second.count, match->second));
+            }
+        }
+    };
+
+    if (static_cast<int>(R.size() + S.size()) <= MEMORY_BLOCKS * BLOCK_SIZE) {
+        auto start = std::chrono::steady_clock::now();
+        profile.onePass = true;
+        std::unordered_map<int, GroupAggregate<T>> groupsR, groupsS;
+        for (const auto& tuple : S) {
+            mergeInto(groupsS, partialAggregate(tuple));
+        }
+        for (const auto& tuple : R) {
+            mergeInto(groupsR, partialR(tuple));
+        }
+        joinGroups(groupsR, groupsS);
+        profile.outputTuples = output.size();
+        profile.join.wallMillis = elapsedMillis(start);
+        sortGroups(output);
+        return output;
+    }
+
+    // Phase 1: Partitioning with eager aggregation
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<GroupAggregate<T>>> diskHashTableR(MEMORY_BLOCKS);
+    std::vector<std::vector<GroupAggregate<T>>> diskHashTableS(MEMORY_BLOCKS);
+
+    BlockedBloomFilter bloomFilter(S.size());
+    Partitioner<GroupAggregate<T>> partitionerS(diskHashTableS, profile.partitioning);
+    for (const auto& tuple : S) {
+        bloomFilter.insert(tuple.B);
+        addPartial(partitionerS, partialAggregate(tuple));
+    }
+    partitionerS.flushAll();
+
+    Partitioner<GroupAggregate<T>> partitionerR(diskHashTableR, profile.partitioning);
+    for (const auto& tuple : R) {
+        if (!bloomFilter.mayContain(tuple.B)) {
+            profile.bloomFiltered++;
+            continue;
+        }
+        addPartial(partitionerR, partialR(tuple));
+    }
+    partitionerR.flushAll();
+    profile.partitioning.wallMillis = elapsedMillis(start);
+
+    // Phase 2: Join of the groups
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MEMORY_BLOCKS; ++i) {
+        profile.partitionSizesR.push_back(diskHashTableR[i].size());
+        profile.partitionSizesS.push_back(diskHashTableS[i].size());
+
+        std::vector<GroupAggregate<T>> partitionR, partitionS;
+        loadPartition(diskHashTableS[i], partitionS, profile.join);
+        loadPartition(diskHashTableR[i], partitionR, profile.join);
+        std::unordered_map<int, GroupAggregate<T>> groupsR, groupsS;
+        for (const auto& partial : partitionS) {
+            mergeInto(groupsS, partial);
+        }
+        for (const auto& partial : partitionR) {
+            mergeInto(groupsR, partial);
+        }
+        joinGroups(groupsR, groupsS);
+    }
+    profile.join.wallMillis = elapsedMillis(start);
+    profile.outputTuples = output.size();
+    sortGroups(output);
+    return output;
+}
+
+#endif
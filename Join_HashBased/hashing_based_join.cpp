@@ -1,17 +1,22 @@
 #include <iostream>
 #include <vector>
-#include <unordered_map>
 #include <algorithm>
 #include <ctime>
-#include <cstdlib>
+#include <random>
+#include <string>
+#include "hashing_based_join.h"
+#include "join_planner.h"
+#include "hash_aggregation.h"
 
 // RUN THIS IN TERMINAL TO COMPILE:
-// g++ -std=c++17 hashing_based_join.cpp -o hashing_based_join
+// g++ -std=c++17 -pthread hashing_based_join.cpp ../BPlusTree/b_plus_tree.cpp -o hashing_based_join
 // ./hashing_based_join
 
 // DESCRIPTION:
 //1. Data Generation:
-//`generateRelationS(int size)` generates a relation S with a specified number of tuples where B is the key attribute, and C can be of any type. The values of attribute B are random integers between 10,000 and 50,000. The function takes the size of the relation as a parameter and returns the relation S in the form of a vector of tuples.
+//`generateRelationS(int size, std::mt19937& gen)` generates a relation S with a specified number of tuples where B is the key attribute, and C can be of any type. The values of attribute B are random integers between 10,000 and 50,000. The function takes the size of the relation and the random number generator as parameters and returns the relation S in the form of a vector of tuples. All random values are drawn from the given generator, so a fixed seed reproduces the same relations.
+//
+//String C values can be dictionary-encoded: `StringPool` stores each distinct string once and hands out dense 32-bit `DictString` codes, `encodeRelation` turns a `Tuple<std::string>` relation into a `Tuple<DictString>` one and `decodeRelation` turns a join result back into strings for its final consumer.
 //
 //2. Virtual Disk I/O:
 //`readBlock(std::vector<Tuple>& memory, std::vector<Tuple>& disk, int blockNum)` reads a block from the virtual disk to the virtual main memory. It takes the main memory, virtual disk, and block number as arguments, and transfers the contents of the specified block from the disk to the memory.
@@ -21,215 +26,47 @@
 //3. Hash Function:
 //`hashFunction(int value)` maps the B-values of the relations to a proper range for the algorithm. It takes an integer value as an argument and returns its hash using the modulo operator.
 //
+//`BlockedBloomFilter` is a Bloom filter over B-values split into 64-byte blocks (one cache line each). A key selects one block and sets one bit in each of the block's eight 64-bit words, so inserting or probing a key touches a single cache line. When compiled with AVX2 (e.g. `-mavx2`) a probe computes and tests all eight bits with a handful of vector instructions.
+//
 //4. Join Algorithm:
-//`twoPassJoin(std::vector<Tuple>& R, std::vector<Tuple>& S, int& diskIOs)` performs a natural join operation based on hashing. It takes relations R and S as input and counts the number of disk I/Os during the join operation. The function first checks if a one-pass join is possible, otherwise, it proceeds with a two-pass join.
+//`twoPassJoin(std::vector<Tuple>& R, std::vector<Tuple>& S, int& diskIOs)` performs a natural join operation based on hashing. It takes relations R and S as input and stores the number of disk I/Os of this join (blocks written in Phase 1 plus blocks read in Phase 2) in `diskIOs`. The overload `twoPassJoin(R, S, JoinProfile& profile)` fills a `JoinProfile` instead: blocks and bytes read/written and wall time per phase, the partition size histogram of R and S, the load factor of each partition's hash table, the probe hit rate and the number of R tuples dropped by the Bloom filter. `JoinProfile::toJson()` renders the profile as a single JSON object. The function first checks if a one-pass join is possible, otherwise, it proceeds with a two-pass join.
 //
 //- One-pass join: If the total number of tuples in R and S is less than or equal to the available tuples in the virtual main memory, a one-pass join is performed. The function builds hash tables for both relations R and S, and joins the tuples based on their B-values. The disk I/Os count for one-pass join is set to 0 since it does not require accessing the virtual disk.
 //- Two-pass join: If a one-pass join is not possible, the function proceeds with the two-pass join algorithm. The join operation is divided into two phases: Partitioning and Join.
-//  - Partitioning: This phase divides both relations R and S into blocks using the hash function. It partitions the tuples based on their B-values and writes them to the virtual disk when the virtual main memory is full.
-//  - Join: This phase reads the tuples from the virtual main memory and the virtual disk into hash tables. It then joins the corresponding tuples from R and S based on their B-values and stores the results in an output vector.
+//  - Partitioning: This phase divides both relations R and S into blocks using the hash function. It partitions the tuples based on their B-values into separate R and S partitions and writes a block to the virtual disk whenever its memory buffer is full; the last, partially filled buffer of every partition is written as well. S (the build side) is partitioned first and its B-values are added to a `BlockedBloomFilter`; R (the probe side) is partitioned afterwards and every R tuple whose B-value is not in the filter is dropped before it reaches a partition, so non-matching R tuples cost neither memory nor disk I/Os. Pass `useBloomFilter = false` to partition every R tuple.
+//  - Join: This phase reads each pair of partitions from the virtual disk block by block into hash tables. It then joins the corresponding tuples from R and S based on their B-values and stores the results in an output vector.
 //
 //5. Experiment:
-//`generateRelationR(int size, const std::vector<Tuple>& S)` generates a relation R with a specified number of tuples, where the values of the attribute B are randomly picked from the relation S, and the attribute A can be of any type. It returns the generated relation R.
+//`generateRelationR(int size, const std::vector<Tuple>& S, std::mt19937& gen)` generates a relation R with a specified number of tuples, where the values of the attribute B are randomly picked from the relation S, and the attribute A can be of any type. It returns the generated relation R.
 //
-//The main function performs three experiments:
+//All types and functions above live in `hashing_based_join.h` so that other programs, such as the benchmark in `join_benchmark.cpp`, can share them. The main function takes an optional seed as its first argument (default: the current time) and performs the following experiments:
 //
 //- One-pass join example: Generates relations S_small and R_small with a total number of tuples that fit within the virtual main memory (120 tuples). This example will execute the one-pass join algorithm in the twoPassJoin function. It then prints the disk I/Os used and the resulting tuples in the join.
 //- 5.1: Generates a relation R and calculates its natural join with the relation S using the twoPassJoin function. It then prints the disk I/Os used and the tuples in the join with random B-values.
 //- 5.2: Generates another relation R with 1,200 tuples and calculates its natural join with the relation S using the twoPassJoin function. In this experiment, the values of the attribute B are randomly picked from integers between 20,000 and 30,000, but not necessarily from the B-values in the relation S. It then prints the disk I/Os used and all the tuples in the join R(A, B) ⋈ S(B, C).
+//- Sort-merge join example: Indexes the relation S from 5.1 on B with a `BPlusTree` (values are positions in S) and joins it with R through `plannedJoin` from `join_planner.h`, asking for output sorted on B. The planner picks the sort-merge join from `sort_merge_join.h`, which reads S in B order along the leaf chain and only sorts R (external merge sort under the same memory budget).
+//- Index nested-loop join example: Joins 20 new R tuples with the indexed S. The planner picks the index nested-loop join from `index_nested_loop_join.h`, which sorts the R tuples on B and probes the tree, touching only the leaves that hold their B-values.
+//- Aggregate join example: Computes `SELECT B, COUNT(C), SUM(C), MIN(C), MAX(C) FROM R ⋈ S GROUP BY B` for R and S from 5.1 with `aggregateJoin` from `hash_aggregation.h`, once with eager aggregation and once by joining first, and prints both disk I/O counts and the first groups. `hashAggregate` groups a single relation by B on the same partitioning: records are `GroupAggregate` partial aggregates, and a record whose B-value is already in its partition's memory block is merged into it instead of taking a new slot. With eager aggregation, S is partitioned as partial aggregates of C and R as partial counts per B-value, so Phase 2 joins one group per B-value and side and never produces the individual matches.
+//- Example with string C: Generates relations with string C values, dictionary-encodes them into a `StringPool` (`encodeRelation`), joins the `Tuple<DictString>` relations, whose C is a 32-bit code, with twoPassJoin and decodes the result with `decodeRelation` only to print it. Partitioning and joining therefore copy 12-byte tuples instead of strings.
 //
 //In summary, the code generates relations R and S, simulates virtual disk I/Os, and performs one-pass and two-pass natural join operations using a hash-based approach. It also counts the disk I/Os used during the join operations and provides output for different experiments.
 
-const int BLOCK_SIZE = 8;
-const int MEMORY_BLOCKS = 15;
-const int TUPLE_R = 1000;
-const int TUPLE_S = 5000;
-
-template<typename T>
-struct Tuple {
-    int A, B;
-    T C;
-};
-
-// Part 1: Data Generation
-
-template<typename T>
-std::vector<Tuple<T>> generateRelationS(int size) {
-    std::vector<Tuple<T>> relation;
-    for (int i = 0; i < size; ++i) {
-        int B = rand() % 40001 + 10000;
-        T C;
-        if constexpr (std::is_same_v<T, std::string>) {
-            C = "_STR_" + std::to_string(rand() % 100000);
-        } else {
-            C = static_cast<T>(rand() % 100000);
-        }
-        relation.push_back({0, B, C});
-    }
-    return relation;
-}
-
-
-// Part 2: Virtual Disk I/O
-template<typename T>
-void readBlock(std::vector<Tuple<T>>& memory, std::vector<Tuple<T>>& disk, int blockNum) {
-    int startIndex = blockNum * BLOCK_SIZE;
-    for (int i = startIndex; i < startIndex + BLOCK_SIZE && i < disk.size(); ++i) {
-        memory.push_back(disk[i]);
-    }
-}
-
-template<typename T>
-void writeBlock(std::vector<Tuple<T>>& memory, std::vector<Tuple<T>>& disk) {
-    for (const auto& tuple : memory) {
-        disk.push_back(tuple);
-    }
-    memory.clear();
-}
-
-// Part 3: Hash Function
-int hashFunction(int value) {
-    return value % MEMORY_BLOCKS;
-}
-
-// Part 4: Join Algorithm
-template<typename T>
-std::vector<Tuple<T>> twoPassJoin(std::vector<Tuple<T>>& R, std::vector<Tuple<T>>& S, int& diskIOs) {
-    std::vector<Tuple<T>> output;
-    int totalTuples = static_cast<int>(R.size() + S.size());
-
-    // One-pass join, if possible
-    if (totalTuples <= MEMORY_BLOCKS * BLOCK_SIZE) {
-        std::unordered_map<int, std::vector<Tuple<T>>> R_map, S_map;
-
-        for (const auto& tuple : R) {
-            R_map[tuple.B].push_back(tuple);
-        }
-        for (const auto& tuple : S) {
-            S_map[tuple.B].push_back(tuple);
-        }
-
-        for (const auto& pair : R_map) {
-            if (S_map.find(pair.first) != S_map.end()) {
-                for (const auto& r_tuple : pair.second) {
-                    for (const auto& s_tuple : S_map[pair.first]) {
-                        output.push_back({r_tuple.A, r_tuple.B, s_tuple.C});
-                    }
-                }
-            }
-        }
-
-        return output;
-    }
-    std::vector<std::vector<Tuple<T>>> memoryHashTable(MEMORY_BLOCKS);
-    std::vector<std::vector<Tuple<T>>> diskHashTable(MEMORY_BLOCKS);
-
-    // Phase 1: Partitioning
-    for (const auto& tuple : R) {
-        int bucket = hashFunction(tuple.B);
-        if (memoryHashTable[bucket].size() < BLOCK_SIZE) {
-            memoryHashTable[bucket].push_back(tuple);
-        } else {
-            writeBlock(memoryHashTable[bucket], diskHashTable[bucket]);
-            diskIOs++;
-            memoryHashTable[bucket].push_back(tuple);
-        }
-    }
-
-    for (const auto& tuple : S) {
-        int bucket = hashFunction(tuple.B);
-        if (memoryHashTable[bucket].size() < BLOCK_SIZE) {
-            memoryHashTable[bucket].push_back(tuple);
-        } else {
-            writeBlock(memoryHashTable[bucket], diskHashTable[bucket]);
-            diskIOs++;
-            memoryHashTable[bucket].push_back(tuple);
-        }
-    }
-
-    // Phase 2: Join
-    for (int i = 0; i < MEMORY_BLOCKS; ++i) {
-            std::unordered_map<int, std::vector<Tuple<T>>> R_map, S_map;
-
-            for (const auto& tuple : memoryHashTable[i]) {
-                if constexpr (std::is_same_v<T, std::string>) {
-                    if (tuple.C == "0") {
-                        R_map[tuple.B].push_back(tuple);
-                    } else {
-                        S_map[tuple.B].push_back(tuple);
-                    }
-                } else {
-                    if (tuple.C == 0) {
-                        R_map[tuple.B].push_back(tuple);
-                    } else {
-                        S_map[tuple.B].push_back(tuple);
-                    }
-                }
-            }
-
-            for (const auto& tuple : diskHashTable[i]) {
-                if constexpr (std::is_same_v<T, std::string>) {
-                    if (tuple.C == "0") {
-                        R_map[tuple.B].push_back(tuple);
-                    } else {
-                        S_map[tuple.B].push_back(tuple);
-                    }
-                } else {
-                    if (tuple.C == 0) {
-                        R_map[tuple.B].push_back(tuple);
-                    } else {
-                        S_map[tuple.B].push_back(tuple);
-                    }
-                }
-            }
-
-            for (const auto& pair : R_map) {
-                if (S_map.find(pair.first) != S_map.end()) {
-                    for (const auto& r_tuple : pair.second) {
-                        for (const auto& s_tuple : S_map[pair.first]) {
-                            if constexpr (std::is_same_v<T, std::string>) {
-                                output.push_back({r_tuple.A, r_tuple.B, s_tuple.C.substr(1)}); // Remove the "C" prefix
-                            } else {
-                                output.push_back({r_tuple.A, r_tuple.B, s_tuple.C});
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    
-    return output;
-}
-
-// Part 5: Experiment
-template<typename T>
-std::vector<Tuple<T>> generateRelationR(int size, const std::vector<Tuple<T>>& S) {
-    std::vector<Tuple<T>> relation;
-    for (int i = 0; i < size; ++i) {
-        int A = rand() % 100000;
-        int B = S[rand() % S.size()].B;
-        T C;
-        if constexpr (std::is_same_v<T, std::string>) {
-            C = "0";
-        } else {
-            C = static_cast<T>(0);
-        }
-        relation.push_back({A, B, C});
-    }
-    return relation;
-}
-
-
-int main() {
-    srand(time(0));
+int main(int argc, char* argv[]) {
+    // Pass a seed as the first argument to make a run reproducible.
+    unsigned int seed = argc > 1 ? static_cast<unsigned int>(std::stoul(argv[1])) : static_cast<unsigned int>(time(0));
+    std::mt19937 gen(seed);
+    std::cout << "Seed: " << seed << std::endl;
     int diskIOs = 0;
+    JoinProfile profile;
 
     // One-pass join example
-    std::vector<Tuple<int>> S_small = generateRelationS<int>(100);
-    std::vector<Tuple<int>> R_small = generateRelationR<int>(20, S_small);
-    std::vector<Tuple<int>> joinResult_small = twoPassJoin<int>(R_small, S_small, diskIOs);
+    std::vector<Tuple<int>> S_small = generateRelationS<int>(100, gen);
+    std::vector<Tuple<int>> R_small = generateRelationR<int>(20, S_small, gen);
+    std::vector<Tuple<int>> joinResult_small = twoPassJoin<int>(R_small, S_small, profile);
+    diskIOs = profile.diskIOs();
     std::cout << "One-pass join example\n";
     std::cout << "Disk I/Os for join: " << diskIOs << std::endl;
+    std::cout << "Join profile: " << profile.toJson() << std::endl;
     if (diskIOs == 0) {
         std::cout << "One-pass join succeeded! --> diskIOs = 0" << std::endl;
     } else {
@@ -244,14 +81,17 @@ int main() {
     std::cout << "\n";
 
     // 5.1
-    std::vector<Tuple<int>> S = generateRelationS<int>(TUPLE_S);
-    std::vector<Tuple<int>> R = generateRelationR<int>(TUPLE_R, S);
-    std::vector<Tuple<int>> joinResult = twoPassJoin<int>(R, S, diskIOs);
+    std::vector<Tuple<int>> S = generateRelationS<int>(TUPLE_S, gen);
+    std::vector<Tuple<int>> R = generateRelationR<int>(TUPLE_R, S, gen);
+    std::vector<Tuple<int>> joinResult = twoPassJoin<int>(R, S, profile);
+    diskIOs = profile.diskIOs();
     std::cout << "Disk I/Os for join: " << diskIOs << std::endl;
+    std::cout << "Join profile: " << profile.toJson() << std::endl;
 
     std::vector<int> randomBvalues;
+    std::uniform_int_distribution<size_t> disS(0, S.size() - 1);
     for (int i = 0; i < 20; ++i) {
-        randomBvalues.push_back(S[rand() % S.size()].B);
+        randomBvalues.push_back(S[disS(gen)].B);
     }
 
     std::cout << "Tuples with random B-values:\n";
@@ -265,15 +105,18 @@ int main() {
     
     std::cout << "Two-pass join example\n";
     std::vector<Tuple<int>> R2(TUPLE_R + 200);
+    std::uniform_int_distribution<> disA(0, 99999);
+    std::uniform_int_distribution<> disB(20000, 30000);
     for (int i = 0; i < TUPLE_R + 200; ++i) {
-        int A = rand() % 100000;
-        int B = rand() % 10001 + 20000;
+        int A = disA(gen);
+        int B = disB(gen);
         R2[i] = {A, B, 0};
     }
 
-    diskIOs = 0;
-    joinResult = twoPassJoin<int>(R2, S, diskIOs);
+    joinResult = twoPassJoin<int>(R2, S, profile);
+    diskIOs = profile.diskIOs();
     std::cout << "Disk I/Os for join: " << diskIOs << std::endl;
+    std::cout << "Join profile: " << profile.toJson() << std::endl;
     if (diskIOs == 0) {
         std::cout << "One-pass join succeeded! --> diskIOs = 0" << std::endl;
     } else {
@@ -286,14 +129,67 @@ int main() {
     for (const auto& tuple : joinResult) {
         std::cout << "(" << tuple.A << ", " << tuple.B << ", " << tuple.C << ")\n";
     }
-    // Example with string C
-    std::vector<Tuple<std::string>> S_string = generateRelationS<std::string>(10000);
-    std::vector<Tuple<std::string>> R_string = generateRelationR<std::string>(20, S_string);
+
+    // Sort-merge join with S indexed on B
+    BPlusTree indexS(13);
+    for (int i = 0; i < static_cast<int>(S.size()); ++i) {
+        indexS.insert(S[i].B, i);
+    }
+    JoinMethod method;
+    joinResult = plannedJoin<int>({&R}, {&S, false, &indexS}, profile, true, &method);
+    std::cout << std::endl;
+    std::cout << "Sort-merge join example (S indexed on B, sorted output requested)\n";
+    std::cout << "Planner chose: " << joinMethodName(method) << " join" << std::endl;
+    std::cout << "Disk I/Os for join: " << profile.diskIOs() << std::endl;
+    std::cout << "Join profile: " << profile.toJson() << std::endl;
+    std::cout << "Output sorted on B: " << (std::is_sorted(joinResult.begin(), joinResult.end(),
+        [](const Tuple<int>& a, const Tuple<int>& b) { return a.B < b.B; }) ? "yes" : "no") << std::endl;
+    std::cout << "First tuples in the join R(A, B) ⋈ S(B, C):\n";
+    for (size_t i = 0; i < joinResult.size() && i < 10; ++i) {
+        std::cout << "(" << joinResult[i].A << ", " << joinResult[i].B << ", " << joinResult[i].C << ")\n";
+    }
+
+    // Index nested-loop join with a small R and S indexed on B
+    std::vector<Tuple<int>> R_probe = generateRelationR<int>(20, S, gen);
+    joinResult = plannedJoin<int>({&R_probe}, {&S, false, &indexS}, profile, false, &method);
+    std::cout << std::endl;
+    std::cout << "Index nested-loop join example (20 R tuples, S indexed on B)\n";
+    std::cout << "Planner chose: " << joinMethodName(method) << " join" << std::endl;
+    std::cout << "Disk I/Os for join: " << profile.diskIOs() << std::endl;
+    std::cout << "Join profile: " << profile.toJson() << std::endl;
+    std::cout << "All tuples in the join R(A, B) ⋈ S(B, C):\n";
+    for (const auto& tuple : joinResult) {
+        std::cout << "(" << tuple.A << ", " << tuple.B << ", " << tuple.C << ")\n";
+    }
+
+    // Aggregate join: GROUP BY B over R ⋈ S, with and without eager aggregation
+    JoinProfile lazyProfile;
+    std::vector<GroupAggregate<int>> groups = aggregateJoin<int>(R, S, profile);
+    std::vector<GroupAggregate<int>> lazyGroups = aggregateJoin<int>(R, S, lazyProfile, false);
+    std::cout << std::endl;
+    std::cout << "Aggregate join example (SELECT B, COUNT(C), SUM(C), MIN(C), MAX(C) FROM R ⋈ S GROUP BY B)\n";
+    std::cout << "Groups: " << groups.size() << " (join without eager aggregation: " << lazyGroups.size() << ")" << std::endl;
+    std::cout << "Disk I/Os with eager aggregation: " << profile.diskIOs()
+              << ", join then aggregation: " << lazyProfile.diskIOs() << std::endl;
+    std::cout << "Join profile: " << profile.toJson() << std::endl;
+    std::cout << "First groups (B, count, sum, min, max):\n";
+    for (size_t i = 0; i < groups.size() && i < 10; ++i) {
+        std::cout << "(" << groups[i].B << ", " << groups[i].count << ", " << groups[i].sum << ", "
+                  << groups[i].min << ", " << groups[i].max << ")\n";
+    }
+
+    // Example with string C, dictionary-encoded for the join and decoded for printing
+    std::vector<Tuple<std::string>> S_string = generateRelationS<std::string>(10000, gen);
+    std::vector<Tuple<std::string>> R_string = generateRelationR<std::string>(20, S_string, gen);
+    StringPool pool;
+    std::vector<Tuple<DictString>> S_encoded = encodeRelation(S_string, pool);
+    std::vector<Tuple<DictString>> R_encoded = encodeRelation(R_string, pool);
     int stringDiskIOs = 0;
-    std::vector<Tuple<std::string>> joinResult_string = twoPassJoin<std::string>(R_string, S_string, stringDiskIOs);
+    std::vector<Tuple<std::string>> joinResult_string = decodeRelation(twoPassJoin<DictString>(R_encoded, S_encoded, stringDiskIOs), pool);
     std::cout << std::endl;
     std::cout << std::endl;
     std::cout << "Join example with string C\n";
+    std::cout << "Distinct strings in the pool: " << pool.size() << std::endl;
     std::cout << "Disk I/Os for join: " << stringDiskIOs << std::endl;
     if (stringDiskIOs == 0) {
         std::cout << "One-pass join succeeded! --> diskIOs = 0" << std::endl;
@@ -0,0 +1,480 @@
+// hashing_based_join.h
+#ifndef HASHING_BASED_JOIN_H
+#define HASHING_BASED_JOIN_H
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <cstdint>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <deque>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+const int BLOCK_SIZE = 8;
+const int MEMORY_BLOCKS = 15;
+const int TUPLE_R = 1000;
+const int TUPLE_S = 5000;
+
+template<typename T>
+struct Tuple {
+    int A, B;
+    T C;
+};
+
+// Dictionary-encoded string: a 32-bit code into a StringPool. Joins over Tuple<DictString> copy,
+// partition and spill only the code, like the int instantiation; the final consumer decodes.
+struct DictString {
+    uint32_t code = 0;
+
+    bool operator==(DictString other) const { return code == other.code; }
+};
+
+// Deduplicated dictionary shared by the relations of a join. Each distinct string is stored once
+// and gets a dense code in order of first appearance.
+class StringPool {
+public:
+    StringPool() = default;
+    // A copy's `codes` would still view the original's strings. Moving keeps the deque's elements
+    // in place, so the views stay valid.
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+    StringPool(StringPool&&) = default;
+    StringPool& operator=(StringPool&&) = default;
+
+    DictString encode(const std::string& value) {
+        auto found = codes.find(value);
+        if (found != codes.end()) return {found->second};
+        uint32_t code = static_cast<uint32_t>(strings.size());
+        strings.push_back(value);
+        codes.emplace(strings.back(), code);
+        return {code};
+    }
+
+    const std::string& decode(DictString value) const { return strings[value.code]; }
+    size_t size() const { return strings.size(); }
+
+private:
+    std::deque<std::string> strings;  // a deque keeps the strings the views in `codes` point to in place
+    std::unordered_map<std::string_view, uint32_t> codes;
+};
+
+// Part 1: Data Generation
+
+template<typename T>
+std::vector<Tuple<T>> generateRelationS(int size, std::mt19937& gen) {
+    std::vector<Tuple<T>> relation;
+    std::uniform_int_distribution<> disB(10000, 50000);
+    std::uniform_int_distribution<> disC(0, 99999);
+    for (int i = 0; i < size; ++i) {
+        int B = disB(gen);
+        T C;
+        if constexpr (std::is_same_v<T, std::string>) {
+            C = "_STR_" + std::to_string(disC(gen));
+        } else {
+            C = static_cast<T>(disC(gen));
+        }
+        relation.push_back({0, B, C});
+    }
+    return relation;
+}
+
+
+// Dictionary-encodes the C column of a relation into pool.
+inline std::vector<Tuple<DictString>> encodeRelation(const std::vector<Tuple<std::string>>& relation, StringPool& pool) {
+    std::vector<Tuple<DictString>> encoded;
+    encoded.reserve(relation.size());
+    for (const auto& tuple : relation) {
+        encoded.push_back({tuple.A, tuple.B, pool.encode(tuple.C)});
+    }
+    return encoded;
+}
+
+// Decodes a join result for its final consumer.
+inline std::vector<Tuple<std::string>> decodeRelation(const std::vector<Tuple<DictString>>& relation, const StringPool& pool) {
+    std::vector<Tuple<std::string>> decoded;
+    decoded.reserve(relation.size());
+    for (const auto& tuple : relation) {
+        decoded.push_back({tuple.A, tuple.B, pool.decode(tuple.C)});
+    }
+    return decoded;
+}
+
+// Part 2: Virtual Disk I/O
+// Blocks hold BLOCK_SIZE records: tuples, or the partial aggregates of hash_aggregation.h.
+template<typename Record>
+void readBlock(std::vector<Record>& memory, std::vector<Record>& disk, int blockNum) {
+    int startIndex = blockNum * BLOCK_SIZE;
+    for (int i = startIndex; i < startIndex + BLOCK_SIZE && i < static_cast<int>(disk.size()); ++i) {
+        memory.push_back(disk[i]);
+    }
+}
+
+template<typename Record>
+void writeBlock(std::vector<Record>& memory, std::vector<Record>& disk) {
+    for (const auto& tuple : memory) {
+        disk.push_back(tuple);
+    }
+    memory.clear();
+}
+
+// Part 3: Hash Function
+inline int hashFunction(int value) {
+    return value % MEMORY_BLOCKS;
+}
+
+// Blocked Bloom filter used to push the semijoin R ⋉ S down into partitioning.
+// Each key lives in one cache-line-sized block and sets one bit per 64-bit word.
+class BlockedBloomFilter {
+public:
+    explicit BlockedBloomFilter(size_t expectedKeys, int bitsPerKey = 10)
+        : blocks(std::max<size_t>(1, (expectedKeys * bitsPerKey + 511) / 512)) {}
+
+    void insert(int key) {
+        uint64_t hash = mix(key);
+        Block& block = blocks[blockIndex(hash)];
+        uint64_t mask[8];
+        makeMask(static_cast<uint32_t>(hash), mask);
+        for (int i = 0; i < 8; ++i) {
+            block.words[i] |= mask[i];
+        }
+    }
+
+    bool mayContain(int key) const {
+        uint64_t hash = mix(key);
+        const Block& block = blocks[blockIndex(hash)];
+#if defined(__AVX2__)
+        const __m256i salts = _mm256_setr_epi32(SALTS[0], SALTS[1], SALTS[2], SALTS[3],
+                                                SALTS[4], SALTS[5], SALTS[6], SALTS[7]);
+        __m256i bitIndex = _mm256_srli_epi32(
+            _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(hash))), salts), 26);
+        const __m256i one = _mm256_set1_epi64x(1);
+        __m256i maskLow = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bitIndex)));
+        __m256i maskHigh = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bitIndex, 1)));
+        __m256i wordsLow = _mm256_load_si256(reinterpret_cast<const __m256i*>(&block.words[0]));
+        __m256i wordsHigh = _mm256_load_si256(reinterpret_cast<const __m256i*>(&block.words[4]));
+        return _mm256_testc_si256(wordsLow, maskLow) && _mm256_testc_si256(wordsHigh, maskHigh);
+#else
+        uint64_t mask[8];
+        makeMask(static_cast<uint32_t>(hash), mask);
+        uint64_t missing = 0;
+        for (int i = 0; i < 8; ++i) {
+            missing |= mask[i] & ~block.words[i];
+        }
+        return missing == 0;
+#endif
+    }
+
+private:
+    struct alignas(64) Block {
+        uint64_t words[8] = {};
+    };
+
+    static constexpr uint32_t SALTS[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                          0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+    std::vector<Block> blocks;
+
+    static uint64_t mix(int key) {
+        uint64_t h = static_cast<uint32_t>(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    size_t blockIndex(uint64_t hash) const {
+        return static_cast<size_t>(((hash >> 32) * blocks.size()) >> 32);
+    }
+
+    static void makeMask(uint32_t hash, uint64_t mask[8]) {
+        for (int i = 0; i < 8; ++i) {
+            mask[i] = uint64_t(1) << ((hash * SALTS[i]) >> 26);
+        }
+    }
+};
+
+// Part 4: Join Algorithm
+
+// I/O and timing counters for one phase of a join.
+struct PhaseStats {
+    long long blocksRead = 0;
+    long long blocksWritten = 0;
+    long long bytesRead = 0;
+    long long bytesWritten = 0;
+    double wallMillis = 0.0;
+};
+
+// Profile of a single join: per-phase I/O and wall time, partition sizes,
+// per-partition hash table load factors and probe statistics.
+struct JoinProfile {
+    bool onePass = false;
+    PhaseStats partitioning;  // Phase 1 (unused by the one-pass join)
+    PhaseStats join;          // Phase 2, or the whole one-pass join
+    std::vector<int> partitionSizesR;
+    std::vector<int> partitionSizesS;
+    std::vector<double> loadFactors;  // of the S hash table built for each partition
+    long long bloomFiltered = 0;      // R tuples dropped before partitioning
+    long long probes = 0;             // R tuples probed against an S hash table
+    long long probeHits = 0;          // probes that found at least one S tuple
+    long long outputTuples = 0;
+
+    long long blocksRead() const { return partitioning.blocksRead + join.blocksRead; }
+    long long blocksWritten() const { return partitioning.blocksWritten + join.blocksWritten; }
+    long long diskIOs() const { return blocksRead() + blocksWritten(); }
+    double probeHitRate() const { return probes == 0 ? 0.0 : static_cast<double>(probeHits) / probes; }
+
+    std::string toJson() const {
+        std::ostringstream out;
+        auto phase = [&out](const char* name, const PhaseStats& stats) {
+            out << "\"" << name << "\":{\"blocksRead\":" << stats.blocksRead
+                << ",\"blocksWritten\":" << stats.blocksWritten
+                << ",\"bytesRead\":" << stats.bytesRead
+                << ",\"bytesWritten\":" << stats.bytesWritten
+                << ",\"wallMillis\":" << stats.wallMillis << "}";
+        };
+        auto list = [&out](const char* name, const auto& values) {
+            out << "\"" << name << "\":[";
+            for (size_t i = 0; i < values.size(); ++i) {
+                out << (i ? "," : "") << values[i];
+            }
+            out << "]";
+        };
+        out << "{\"onePass\":" << (onePass ? "true" : "false") << ",\"diskIOs\":" << diskIOs() << ",";
+        phase("partitioning", partitioning);
+        out << ",";
+        phase("join", join);
+        out << ",";
+        list("partitionSizesR", partitionSizesR);
+        out << ",";
+        list("partitionSizesS", partitionSizesS);
+        out << ",";
+        list("loadFactors", loadFactors);
+        out << ",\"bloomFiltered\":" << bloomFiltered << ",\"probes\":" << probes
+            << ",\"probeHits\":" << probeHits << ",\"probeHitRate\":" << probeHitRate()
+            << ",\"outputTuples\":" << outputTuples << "}";
+        return out.str();
+    }
+};
+
+template<typename T>
+long long tupleBytes(const Tuple<T>& tuple) {
+    if constexpr (std::is_same_v<T, std::string>) {
+        return 2 * sizeof(int) + tuple.C.size();
+    } else {
+        return sizeof(Tuple<T>);
+    }
+}
+
+inline double elapsedMillis(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Phase 1 of the hash-based operators: records are hashed on B into MEMORY_BLOCKS partitions
+// on the virtual disk through one memory block per partition. Every block that reaches the disk
+// is counted, including the final partially filled block of each partition.
+template<typename Record>
+class Partitioner {
+public:
+    Partitioner(std::vector<std::vector<Record>>& disk, PhaseStats& stats)
+        : memory(MEMORY_BLOCKS), disk(disk), stats(stats) {}
+
+    // The memory block of the partition holding B.
+    std::vector<Record>& block(int B) {
+        return memory[hashFunction(B)];
+    }
+
+    void add(const Record& record) {
+        int bucket = hashFunction(record.B);
+        if (memory[bucket].size() >= BLOCK_SIZE) {
+            flush(bucket);
+        }
+        memory[bucket].push_back(record);
+    }
+
+    void flushAll() {
+        for (int i = 0; i < MEMORY_BLOCKS; ++i) {
+            if (!memory[i].empty()) {
+                flush(i);
+            }
+        }
+    }
+
+private:
+    std::vector<std::vector<Record>> memory;
+    std::vector<std::vector<Record>>& disk;
+    PhaseStats& stats;
+
+    void flush(int bucket) {
+        for (const auto& record : memory[bucket]) {
+            stats.bytesWritten += tupleBytes(record);
+        }
+        writeBlock(memory[bucket], disk[bucket]);
+        stats.blocksWritten++;
+    }
+};
+
+// Phase 2 of the hash-based operators: reads one partition back block by block.
+template<typename Record>
+void loadPartition(std::vector<Record>& disk, std::vector<Record>& memory, PhaseStats& stats) {
+    int blocks = (static_cast<int>(disk.size()) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (int block = 0; block < blocks; ++block) {
+        readBlock(memory, disk, block);
+        stats.blocksRead++;
+    }
+    for (const auto& record : memory) {
+        stats.bytesRead += tupleBytes(record);
+    }
+}
+
+// Phase 2 of a two-pass join for one pair of partitions: builds hash tables on
+// their B-values, probes S with every R tuple and appends the matches to output.
+template<typename T>
+void joinPartition(const std::vector<Tuple<T>>& partitionR, const std::vector<Tuple<T>>& partitionS,
+                   std::vector<Tuple<T>>& output, JoinProfile& profile) {
+    std::unordered_map<int, std::vector<Tuple<T>>> R_map, S_map;
+    for (const auto& tuple : partitionS) {
+        S_map[tuple.B].push_back(tuple);
+    }
+    for (const auto& tuple : partitionR) {
+        R_map[tuple.B].push_back(tuple);
+    }
+    profile.loadFactors.push_back(S_map.load_factor());
+
+    for (const auto& pair : R_map) {
+        profile.probes += pair.second.size();
+        auto match = S_map.find(pair.first);
+        if (match != S_map.end()) {
+            profile.probeHits += pair.second.size();
+            for (const auto& r_tuple : pair.second) {
+                for (const auto& s_tuple : match->second) {
+                    if constexpr (std::is_same_v<T, std::string>) {
+                        output.push_back({r_tuple.A, r_tuple.B, s_tuple.C.substr(1)}); // Remove the "C" prefix
+                    } else {
+                        output.push_back({r_tuple.A, r_tuple.B, s_tuple.C});
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+std::vector<Tuple<T>> twoPassJoin(std::vector<Tuple<T>>& R, std::vector<Tuple<T>>& S, JoinProfile& profile, bool useBloomFilter = true) {
+    std::vector<Tuple<T>> output;
+    int totalTuples = static_cast<int>(R.size() + S.size());
+    profile = JoinProfile();
+
+    // One-pass join, if possible
+    if (totalTuples <= MEMORY_BLOCKS * BLOCK_SIZE) {
+        auto start = std::chrono::steady_clock::now();
+        profile.onePass = true;
+        std::unordered_map<int, std::vector<Tuple<T>>> R_map, S_map;
+
+        for (const auto& tuple : R) {
+            R_map[tuple.B].push_back(tuple);
+        }
+        for (const auto& tuple : S) {
+            S_map[tuple.B].push_back(tuple);
+        }
+        profile.loadFactors.push_back(S_map.load_factor());
+
+        for (const auto& pair : R_map) {
+            profile.probes += pair.second.size();
+            auto match = S_map.find(pair.first);
+            if (match != S_map.end()) {
+                profile.probeHits += pair.second.size();
+                for (const auto& r_tuple : pair.second) {
+                    for (const auto& s_tuple : match->second) {
+                        output.push_back({r_tuple.A, r_tuple.B, s_tuple.C});
+                    }
+                }
+            }
+        }
+
+        profile.outputTuples = output.size();
+        profile.join.wallMillis = elapsedMillis(start);
+        return output;
+    }
+    std::vector<std::vector<Tuple<T>>> diskHashTableR(MEMORY_BLOCKS);
+    std::vector<std::vector<Tuple<T>>> diskHashTableS(MEMORY_BLOCKS);
+
+    // Phase 1: Partitioning
+    auto start = std::chrono::steady_clock::now();
+
+    // S is partitioned first so its B-values can filter R before R reaches any partition.
+    BlockedBloomFilter bloomFilter(useBloomFilter ? S.size() : 0);
+    Partitioner<Tuple<T>> partitionerS(diskHashTableS, profile.partitioning);
+    for (const auto& tuple : S) {
+        if (useBloomFilter) {
+            bloomFilter.insert(tuple.B);
+        }
+        partitionerS.add(tuple);
+    }
+    partitionerS.flushAll();
+
+    Partitioner<Tuple<T>> partitionerR(diskHashTableR, profile.partitioning);
+    for (const auto& tuple : R) {
+        if (useBloomFilter && !bloomFilter.mayContain(tuple.B)) {
+            profile.bloomFiltered++;
+            continue;
+        }
+        partitionerR.add(tuple);
+    }
+    partitionerR.flushAll();
+    profile.partitioning.wallMillis = elapsedMillis(start);
+
+    // Phase 2: Join
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MEMORY_BLOCKS; ++i) {
+        profile.partitionSizesR.push_back(diskHashTableR[i].size());
+        profile.partitionSizesS.push_back(diskHashTableS[i].size());
+
+        std::vector<Tuple<T>> partitionR, partitionS;
+        loadPartition(diskHashTableS[i], partitionS, profile.join);
+        loadPartition(diskHashTableR[i], partitionR, profile.join);
+        joinPartition(partitionR, partitionS, output, profile);
+    }
+    profile.join.wallMillis = elapsedMillis(start);
+    profile.outputTuples = output.size();
+
+    return output;
+}
+
+template<typename T>
+std::vector<Tuple<T>> twoPassJoin(std::vector<Tuple<T>>& R, std::vector<Tuple<T>>& S, int& diskIOs, bool useBloomFilter = true) {
+    JoinProfile profile;
+    std::vector<Tuple<T>> output = twoPassJoin(R, S, profile, useBloomFilter);
+    diskIOs = static_cast<int>(profile.diskIOs());
+    return output;
+}
+
+// Part 5: Experiment
+template<typename T>
+std::vector<Tuple<T>> generateRelationR(int size, const std::vector<Tuple<T>>& S, std::mt19937& gen) {
+    std::vector<Tuple<T>> relation;
+    std::uniform_int_distribution<> disA(0, 99999);
+    std::uniform_int_distribution<size_t> disS(0, S.size() - 1);
+    for (int i = 0; i < size; ++i) {
+        int A = disA(gen);
+        int B = S[disS(gen)].B;
+        T C;
+        if constexpr (std::is_same_v<T, std::string>) {
+            C = "0";
+        } else {
+            C = T();
+        }
+        relation.push_back({A, B, C});
+    }
+    return relation;
+}
+
+#endif
@@ -0,0 +1,74 @@
+// index_nested_loop_join.h
+#ifndef INDEX_NESTED_LOOP_JOIN_H
+#define INDEX_NESTED_LOOP_JOIN_H
+
+#include "hashing_based_join.h"
+#include "../BPlusTree/b_plus_tree.h"
+
+// Index nested-loop join of R with S through a BPlusTree on S.B whose values are positions in S.
+// R is streamed in batches of `batchSize` tuples and every batch is sorted on B, so consecutive
+// probe keys are close together in the tree: the cursor of the previous probe walks forward along
+// the leaf chain and the tree is only descended again when the next key is more than height()
+// leaves away. R tuples with the same B-value reuse the matches of the first one. Only the leaves
+// holding probe keys (and the ones walked past) are touched, never S in full.
+//
+// In the profile, `partitioning` holds the batch sorting time and `join` the probing, with one
+// block read per internal node on a descent and per leaf entered.
+
+template<typename T>
+std::vector<Tuple<T>> indexNestedLoopJoin(const std::vector<Tuple<T>>& R, const BPlusTree& indexS,
+                                          const std::vector<Tuple<T>>& S, JoinProfile& profile,
+                                          size_t batchSize = MEMORY_BLOCKS * BLOCK_SIZE) {
+    profile = JoinProfile();
+    std::vector<Tuple<T>> output;
+    const int height = indexS.height();
+    long long descents = 0;
+    long long leaves = 0;
+    std::vector<Tuple<T>> batch;
+    std::vector<int> matches;
+
+    for (size_t first = 0; first < R.size(); first += batchSize) {
+        auto start = std::chrono::steady_clock::now();
+        batch.assign(R.begin() + first, R.begin() + std::min(R.size(), first + batchSize));
+        std::sort(batch.begin(), batch.end(), [](const Tuple<T>& a, const Tuple<T>& b) { return a.B < b.B; });
+        profile.partitioning.wallMillis += elapsedMillis(start);
+
+        start = std::chrono::steady_clock::now();
+        LeafCursor cursor;
+        bool positioned = false;
+        bool haveMatches = false;
+        int matchedKey = 0;
+        for (const auto& r_tuple : batch) {
+            profile.probes++;
+            if (!haveMatches || r_tuple.B != matchedKey) {
+                if (!positioned || !cursor.seek(r_tuple.B, height)) {
+                    if (positioned) leaves += cursor.leaves_visited();
+                    cursor = indexS.lower_bound(r_tuple.B);
+                    descents++;
+                    positioned = true;
+                }
+                matches.clear();
+                while (cursor.valid() && cursor.key() == r_tuple.B) {
+                    matches.push_back(cursor.value());
+                    cursor.next();
+                }
+                matchedKey = r_tuple.B;
+                haveMatches = true;
+            }
+            if (!matches.empty()) {
+                profile.probeHits++;
+                for (int row : matches) {
+                    output.push_back({r_tuple.A, r_tuple.B, S[row].C});
+                }
+            }
+        }
+        if (positioned) leaves += cursor.leaves_visited();
+        profile.join.wallMillis += elapsedMillis(start);
+    }
+
+    profile.join.blocksRead = descents * std::max(0, height - 1) + leaves;
+    profile.outputTuples = output.size();
+    return output;
+}
+
+#endif
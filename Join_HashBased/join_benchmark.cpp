@@ -0,0 +1,349 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <random>
+#include <sys/resource.h>
+#include "hashing_based_join.h"
+#include "partition_io.h"
+#include "join_planner.h"
+#include "hash_aggregation.h"
+
+// RUN THIS IN TERMINAL TO COMPILE:
+// g++ -std=c++17 -O2 -pthread join_benchmark.cpp ../BPlusTree/b_plus_tree.cpp -o join_benchmark
+// ./join_benchmark
+// ./join_benchmark --join=hash --dist=zipf --type=string --r=1000000 --s=100000 --match=0.2 --seed=7
+
+// DESCRIPTION:
+// A benchmark harness for the join operators in `hashing_based_join.h`. Every run is driven by a
+// seeded `std::mt19937_64`, so the same options always produce the same relations, and no result
+// tuple is printed, so the measured time is the join itself.
+//
+// Options (all of the form --name=value):
+// - `--join`: join variant to run, see `joinVariants()` (default: hash). Variants that use an index on S.B
+//   (sort-merge-index, index-nl, planned) get a BPlusTree built before timing starts. The aggregate joins of
+//   `aggregateVariants()` (agg-join, agg-join-lazy) compute GROUP BY B over R ⋈ S for the int and double types
+//   and report the number of groups as their output tuples.
+// - `--dist`: key distribution of the generated relations (default: uniform).
+//   - `uniform`: S.B is uniform over [0, |S|); matching R tuples take the B-value of a uniformly chosen S tuple.
+//   - `zipf`: S.B follows a Zipf distribution with parameter `--theta` over [0, |S|), so a few B-values dominate both relations.
+//   - `fkpk`: S.B is a primary key (a permutation of [0, |S|)); matching R tuples reference a uniformly chosen key.
+// - `--type`: type of the C value, one of int, double, string, dict (default: int). `dict` uses the same strings as
+//   `string`, dictionary-encoded into a StringPool while S is generated; the timed join includes decoding its output.
+// - `--r`, `--s`: cardinalities of R and S (default: 100000 each, any value from 1K to 100M is fine).
+// - `--match`: fraction of R tuples whose B-value occurs in S (default: 1). The other R tuples get B-values in [|S|, 2|S|), which S never contains.
+// - `--theta`: Zipf parameter, 0 < theta < 1 (default: 0.99).
+// - `--seed`: generator seed (default: 42).
+// - `--reps`: number of timed repetitions (default: 3).
+// - `--all`: run every distribution and C type with the given cardinalities instead of a single configuration.
+//
+// Each configuration prints one JSON line with the mean wall time, tuples/sec (input tuples of R and S per
+// second), the number of output tuples, the peak resident set size of the process so far and the
+// `JoinProfile` of the last repetition.
+
+struct BenchmarkConfig {
+    std::string join = "hash";
+    std::string distribution = "uniform";
+    std::string type = "int";
+    long long sizeR = 100000;
+    long long sizeS = 100000;
+    double matchRate = 1.0;
+    double zipfTheta = 0.99;
+    unsigned long long seed = 42;
+    int repetitions = 3;
+};
+
+// Zipf sampler from Gray et al., "Quickly Generating Billion-Record Synthetic Databases":
+// O(n) setup, O(1) per sample, no table, so it scales to 100M distinct values.
+class ZipfGenerator {
+public:
+    ZipfGenerator(long long n, double theta) : n(n), theta(theta) {
+        double zeta2 = 1.0 + std::pow(0.5, theta);
+        zetan = 0.0;
+        for (long long i = 1; i <= n; ++i) {
+            zetan += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+        secondThreshold = zeta2;
+    }
+
+    long long operator()(std::mt19937_64& gen) {
+        double u = std::uniform_real_distribution<>(0.0, 1.0)(gen);
+        double uz = u * zetan;
+        if (uz < 1.0) return 0;
+        if (uz < secondThreshold) return 1;
+        long long value = static_cast<long long>(n * std::pow(eta * u - eta + 1.0, alpha));
+        return std::min(value, n - 1);
+    }
+
+private:
+    long long n;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+    double secondThreshold;
+};
+
+// Pool for the dict type: the benchmark's string C values, encoded once while generating S.
+StringPool& benchmarkPool() {
+    static StringPool pool;
+    return pool;
+}
+
+// C value of an S tuple: 1 to 100000 for integer types (plus 0.5 for floating point ones), a string or its dictionary code.
+template<typename T>
+T makeC(long long value) {
+    if constexpr (std::is_same_v<T, std::string>) {
+        return "_STR_" + std::to_string(value % 100000 + 1);
+    } else if constexpr (std::is_same_v<T, DictString>) {
+        return benchmarkPool().encode(makeC<std::string>(value));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return static_cast<T>(value % 100000 + 1) + static_cast<T>(0.5);
+    } else {
+        return static_cast<T>(value % 100000 + 1);
+    }
+}
+
+template<typename T>
+std::vector<Tuple<T>> generateBuildRelation(const BenchmarkConfig& config, std::mt19937_64& gen) {
+    std::vector<Tuple<T>> relation;
+    relation.reserve(config.sizeS);
+    std::uniform_int_distribution<long long> disC(0, 99999);
+
+    if (config.distribution == "fkpk") {
+        std::vector<int> keys(config.sizeS);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::shuffle(keys.begin(), keys.end(), gen);
+        for (int key : keys) {
+            relation.push_back({0, key, makeC<T>(disC(gen))});
+        }
+    } else if (config.distribution == "zipf") {
+        ZipfGenerator zipf(config.sizeS, config.zipfTheta);
+        for (long long i = 0; i < config.sizeS; ++i) {
+            relation.push_back({0, static_cast<int>(zipf(gen)), makeC<T>(disC(gen))});
+        }
+    } else {
+        std::uniform_int_distribution<int> disB(0, static_cast<int>(config.sizeS - 1));
+        for (long long i = 0; i < config.sizeS; ++i) {
+            relation.push_back({0, disB(gen), makeC<T>(disC(gen))});
+        }
+    }
+    return relation;
+}
+
+template<typename T>
+std::vector<Tuple<T>> generateProbeRelation(const BenchmarkConfig& config, const std::vector<Tuple<T>>& S, std::mt19937_64& gen) {
+    std::vector<Tuple<T>> relation;
+    relation.reserve(config.sizeR);
+    std::uniform_int_distribution<int> disA(0, 99999);
+    std::uniform_real_distribution<> disMatch(0.0, 1.0);
+    std::uniform_int_distribution<size_t> disS(0, S.size() - 1);
+    std::uniform_int_distribution<int> disMiss(static_cast<int>(config.sizeS), static_cast<int>(2 * config.sizeS - 1));
+
+    for (long long i = 0; i < config.sizeR; ++i) {
+        int B;
+        if (disMatch(gen) < config.matchRate) {
+            B = config.distribution == "fkpk" ? static_cast<int>(disS(gen)) : S[disS(gen)].B;
+        } else {
+            B = disMiss(gen);
+        }
+        relation.push_back({disA(gen), B, T()});
+    }
+    return relation;
+}
+
+// The relations a join variant runs on. `indexS` is a BPlusTree on S.B whose values are positions
+// in S; it is only built, before timing starts, for variants that need it.
+template<typename T>
+struct BenchmarkInputs {
+    std::vector<Tuple<T>> R;
+    std::vector<Tuple<T>> S;
+    std::unique_ptr<BPlusTree> indexS;
+};
+
+template<typename T>
+struct JoinVariant {
+    std::function<std::vector<Tuple<T>>(BenchmarkInputs<T>&, JoinProfile&)> run;
+    bool needsIndex = false;
+};
+
+const int INDEX_ORDER = 64;
+
+// Every join operator the benchmark can drive, by name. New join variants register here.
+template<typename T>
+std::map<std::string, JoinVariant<T>> joinVariants() {
+    return {
+        {"hash", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return twoPassJoin(in.R, in.S, profile, true);
+         }}},
+        {"hash-nobloom", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return twoPassJoin(in.R, in.S, profile, false);
+         }}},
+        {"sort-merge", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return sortMergeJoin(in.R, in.S, profile);
+         }}},
+        {"sort-merge-index", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return sortMergeJoin(JoinInput<T>{&in.R}, JoinInput<T>{&in.S, false, in.indexS.get()}, profile);
+         }, true}},
+        {"index-nl", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return indexNestedLoopJoin(in.R, *in.indexS, in.S, profile);
+         }, true}},
+        {"planned", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return plannedJoin(JoinInput<T>{&in.R}, JoinInput<T>{&in.S, false, in.indexS.get()}, profile);
+         }, true}},
+        {"hash-spill", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             std::unique_ptr<AsyncFileIO> io = createAsyncFileIO(true);
+             return spillingJoin(in.R, in.S, profile, *io);
+         }}},
+        {"hash-spill-threads", {[](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             std::unique_ptr<AsyncFileIO> io = createAsyncFileIO(false);
+             return spillingJoin(in.R, in.S, profile, *io);
+         }}},
+    };
+}
+
+// SELECT B, COUNT(C), SUM(C), MIN(C), MAX(C) FROM R ⋈ S GROUP BY B, with and without eager aggregation.
+template<typename T>
+std::map<std::string, std::function<std::vector<GroupAggregate<T>>(BenchmarkInputs<T>&, JoinProfile&)>> aggregateVariants() {
+    return {
+        {"agg-join", [](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return aggregateJoin(in.R, in.S, profile, true);
+         }},
+        {"agg-join-lazy", [](BenchmarkInputs<T>& in, JoinProfile& profile) {
+             return aggregateJoin(in.R, in.S, profile, false);
+         }},
+    };
+}
+
+long peakRssKilobytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+template<typename T>
+void runBenchmark(const BenchmarkConfig& config) {
+    // Runs the variant once and returns the number of output tuples seen by the final consumer.
+    std::function<size_t(BenchmarkInputs<T>&, JoinProfile&)> run;
+    bool needsIndex = false;
+    auto variants = joinVariants<T>();
+    auto variant = variants.find(config.join);
+    if (variant != variants.end()) {
+        run = [join = variant->second.run](BenchmarkInputs<T>& in, JoinProfile& profile) {
+            std::vector<Tuple<T>> result = join(in, profile);
+            if constexpr (std::is_same_v<T, DictString>) {
+                // Decoding for the final consumer is part of the cost of a dictionary-encoded join.
+                return decodeRelation(result, benchmarkPool()).size();
+            } else {
+                return result.size();
+            }
+        };
+        needsIndex = variant->second.needsIndex;
+    }
+    if constexpr (std::is_arithmetic_v<T>) {
+        auto aggregates = aggregateVariants<T>();
+        auto aggregate = aggregates.find(config.join);
+        if (aggregate != aggregates.end()) {
+            run = [join = aggregate->second](BenchmarkInputs<T>& in, JoinProfile& profile) { return join(in, profile).size(); };
+        }
+    }
+    if (!run) {
+        std::cerr << "Unknown join variant for C type " << config.type << ": " << config.join << std::endl;
+        return;
+    }
+
+    std::mt19937_64 gen(config.seed);
+    BenchmarkInputs<T> inputs;
+    inputs.S = generateBuildRelation<T>(config, gen);
+    inputs.R = generateProbeRelation<T>(config, inputs.S, gen);
+    if (needsIndex) {
+        inputs.indexS = std::make_unique<BPlusTree>(INDEX_ORDER);
+        for (int i = 0; i < static_cast<int>(inputs.S.size()); ++i) {
+            inputs.indexS->insert(inputs.S[i].B, i);
+        }
+    }
+
+    JoinProfile profile;
+    size_t outputTuples = 0;
+    double totalSeconds = 0.0;
+    for (int rep = 0; rep < config.repetitions; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        outputTuples = run(inputs, profile);
+        totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    double seconds = totalSeconds / config.repetitions;
+    double tuplesPerSec = seconds > 0 ? (config.sizeR + config.sizeS) / seconds : 0.0;
+
+    std::cout << "{\"join\":\"" << config.join << "\",\"dist\":\"" << config.distribution
+              << "\",\"type\":\"" << config.type << "\",\"r\":" << config.sizeR << ",\"s\":" << config.sizeS
+              << ",\"match\":" << config.matchRate << ",\"seed\":" << config.seed
+              << ",\"reps\":" << config.repetitions << ",\"seconds\":" << seconds
+              << ",\"tuplesPerSec\":" << tuplesPerSec << ",\"outputTuples\":" << outputTuples
+              << ",\"peakRssKB\":" << peakRssKilobytes() << ",\"profile\":" << profile.toJson() << "}"
+              << std::endl;
+}
+
+void runBenchmark(const BenchmarkConfig& config) {
+    if (config.type == "int") {
+        runBenchmark<int>(config);
+    } else if (config.type == "double") {
+        runBenchmark<double>(config);
+    } else if (config.type == "string") {
+        runBenchmark<std::string>(config);
+    } else if (config.type == "dict") {
+        runBenchmark<DictString>(config);
+    } else {
+        std::cerr << "Unknown C type: " << config.type << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    bool all = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if (name == "--join") config.join = value;
+        else if (name == "--dist") config.distribution = value;
+        else if (name == "--type") config.type = value;
+        else if (name == "--r") config.sizeR = std::stoll(value);
+        else if (name == "--s") config.sizeS = std::stoll(value);
+        else if (name == "--match") config.matchRate = std::stod(value);
+        else if (name == "--theta") config.zipfTheta = std::stod(value);
+        else if (name == "--seed") config.seed = std::stoull(value);
+        else if (name == "--reps") config.repetitions = std::max(1, std::stoi(value));
+        else if (name == "--all") all = true;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (config.distribution != "uniform" && config.distribution != "zipf" && config.distribution != "fkpk") {
+        std::cerr << "Unknown distribution: " << config.distribution << std::endl;
+        return 1;
+    }
+
+    if (!all) {
+        runBenchmark(config);
+        return 0;
+    }
+
+    for (const char* distribution : {"uniform", "zipf", "fkpk"}) {
+        for (const char* type : {"int", "double", "string", "dict"}) {
+            config.distribution = distribution;
+            config.type = type;
+            runBenchmark(config);
+        }
+    }
+    return 0;
+}
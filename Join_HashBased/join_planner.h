@@ -0,0 +1,103 @@
+// join_planner.h
+#ifndef JOIN_PLANNER_H
+#define JOIN_PLANNER_H
+
+#include "hashing_based_join.h"
+#include "sort_merge_join.h"
+#include "index_nested_loop_join.h"
+
+// Picks a join method for R(A, B) ⋈ S(B, C) from what is known about the inputs (sorted on B,
+// indexed on B by a BPlusTree) and runs it.
+
+enum class JoinMethod { Hash, SortMerge, IndexNestedLoop };
+
+inline const char* joinMethodName(JoinMethod method) {
+    switch (method) {
+        case JoinMethod::Hash: return "hash";
+        case JoinMethod::SortMerge: return "sort-merge";
+        case JoinMethod::IndexNestedLoop: return "index nested-loop";
+    }
+    return "unknown";
+}
+
+inline long long blocksOf(size_t tuples) {
+    return (static_cast<long long>(tuples) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+// Block I/Os of sorting `tuples` tuples in `blocks` blocks with ExternalSortInput: run generation
+// reads and writes every block, each intermediate merge pass (at most `fanIn` runs per merge)
+// reads and writes them again and the final merge reads them once.
+inline long long externalSortCost(size_t tuples, long long blocks, int fanIn) {
+    const long long memoryTuples = MEMORY_BLOCKS * BLOCK_SIZE;
+    long long runs = (static_cast<long long>(tuples) + memoryTuples - 1) / memoryTuples;
+    long long passes = 0;
+    while (runs > fanIn) {
+        runs = (runs + fanIn - 1) / fanIn;
+        passes++;
+    }
+    return (3 + 2 * passes) * blocks;
+}
+
+// Estimated block I/Os of each method:
+// - hash join: 3(B(R) + B(S)), reading both inputs, writing and reading back their partitions;
+// - sort-merge join: B(X) for a sorted input (one scan), one descent plus every leaf of the tree for
+//   an indexed one (a leaf-chain scan) and (3 + 2p)B(X) for one it has to sort, where p is the
+//   number of merge passes the external sort needs before its runs fit into the final merge;
+// - index nested-loop join (S indexed): B(R) plus, for every batch of R, one descent per R tuple
+//   of the batch or one descent and a walk over every leaf of S, whichever is smaller. Each batch
+//   starts a new cursor, so the leaf chain may be walked once per batch; the join only pays off
+//   when R is small.
+// Sorted output forces the sort-merge join, since the other two only sort within partitions or batches.
+template<typename T>
+JoinMethod chooseJoinMethod(const JoinInput<T>& R, const JoinInput<T>& S, bool needSortedOutput = false) {
+    if (needSortedOutput) return JoinMethod::SortMerge;
+    if (static_cast<int>(R.relation->size() + S.relation->size()) <= MEMORY_BLOCKS * BLOCK_SIZE) return JoinMethod::Hash;
+
+    long long blocksR = blocksOf(R.relation->size());
+    long long blocksS = blocksOf(S.relation->size());
+    long long hashCost = 3 * (blocksR + blocksS);
+    const int fanIn = std::max(2, (MEMORY_BLOCKS - 1) / 2);
+    // Height and leaf count of each index, read once per plan.
+    auto indexShape = [](const JoinInput<T>& input) {
+        if (!input.indexOnB) return std::make_pair(0LL, 0LL);
+        return std::make_pair(static_cast<long long>(input.indexOnB->height()),
+                              static_cast<long long>(input.indexOnB->leaf_count()));
+    };
+    const std::pair<long long, long long> shapeR = indexShape(R);
+    const std::pair<long long, long long> shapeS = indexShape(S);
+    auto inputCost = [fanIn](const JoinInput<T>& input, long long blocks, const std::pair<long long, long long>& shape) {
+        if (input.indexOnB) return shape.first + shape.second;
+        if (input.sortedOnB) return blocks;
+        return externalSortCost(input.relation->size(), blocks, fanIn);
+    };
+    long long mergeCost = inputCost(R, blocksR, shapeR) + inputCost(S, blocksS, shapeS);
+
+    JoinMethod best = mergeCost < hashCost ? JoinMethod::SortMerge : JoinMethod::Hash;
+    if (S.indexOnB) {
+        const long long batchSize = MEMORY_BLOCKS * BLOCK_SIZE;
+        const long long height = shapeS.first;
+        const long long leavesS = shapeS.second;
+        long long tuplesR = static_cast<long long>(R.relation->size());
+        auto batchCost = [&](long long tuples) { return std::min(tuples * height, leavesS + height); };
+        long long indexCost = blocksR + (tuplesR / batchSize) * batchCost(batchSize) + batchCost(tuplesR % batchSize);
+        if (indexCost < std::min(hashCost, mergeCost)) best = JoinMethod::IndexNestedLoop;
+    }
+    return best;
+}
+
+// Joins R and S with the method chooseJoinMethod picks and reports it through `method`.
+template<typename T>
+std::vector<Tuple<T>> plannedJoin(const JoinInput<T>& R, const JoinInput<T>& S, JoinProfile& profile,
+                                  bool needSortedOutput = false, JoinMethod* method = nullptr) {
+    JoinMethod chosen = chooseJoinMethod(R, S, needSortedOutput);
+    if (method) *method = chosen;
+    if (chosen == JoinMethod::Hash) {
+        return twoPassJoin(*R.relation, *S.relation, profile);
+    }
+    if (chosen == JoinMethod::IndexNestedLoop) {
+        return indexNestedLoopJoin(*R.relation, *S.indexOnB, *S.relation, profile);
+    }
+    return sortMergeJoin(R, S, profile);
+}
+
+#endif
@@ -0,0 +1,638 @@
+// partition_io.h
+#ifndef PARTITION_IO_H
+#define PARTITION_IO_H
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+// <linux/io_uring.h> pulls in <linux/fs.h>, whose BLOCK_SIZE macro would replace the join's block size.
+#undef BLOCK_SIZE
+#include "hashing_based_join.h"
+
+// File-backed partitions for the two-pass join. Pages are written and read through an
+// AsyncFileIO backend (io_uring, or a pread/pwrite thread pool where io_uring is not
+// available), every partition double-buffers its output page so partitioning keeps running
+// while the previous page is being written, and Phase 2 prefetches partition i + 1 while
+// partition i is being built and probed.
+
+const size_t PAGE_BYTES = 64 * 1024;
+
+// Part 1: Asynchronous I/O backends
+
+// Submits page reads and writes at explicit file offsets. Each request returns a ticket;
+// wait(ticket) blocks until that request has completed and throws if it failed or if the ticket
+// is unknown, e.g. because it has already been waited on.
+class AsyncFileIO {
+public:
+    virtual ~AsyncFileIO() = default;
+    virtual uint64_t submitWrite(int fd, const void* buffer, size_t length, off_t offset) = 0;
+    virtual uint64_t submitRead(int fd, void* buffer, size_t length, off_t offset) = 0;
+    virtual void wait(uint64_t ticket) = 0;
+    virtual const char* name() const = 0;
+};
+
+inline void checkTransfer(long result, size_t length, const char* what) {
+    if (result < 0) {
+        throw std::runtime_error(std::string(what) + " failed: " + std::strerror(static_cast<int>(-result)));
+    }
+    if (static_cast<size_t>(result) != length) {
+        throw std::runtime_error(std::string(what) + " transferred " + std::to_string(result) + " of " +
+                                 std::to_string(length) + " bytes");
+    }
+}
+
+// io_uring backend driven directly through the io_uring_setup/io_uring_enter system calls. The
+// constructor throws unless the kernel supports IORING_OP_READ and IORING_OP_WRITE: kernels 5.1 to
+// 5.5 set up rings but fail those requests with -EINVAL.
+class IoUringIO : public AsyncFileIO {
+public:
+    explicit IoUringIO(unsigned entries = 64) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+        }
+        // The destructor does not run for a constructor that throws.
+        try {
+            mapRings(params);
+            requireReadWrite();
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    ~IoUringIO() override {
+        while (inFlight > 0) {
+            enter(0, 1);
+            reap();
+        }
+        release();
+    }
+
+    uint64_t submitWrite(int fd, const void* buffer, size_t length, off_t offset) override {
+        return submit(IORING_OP_WRITE, fd, const_cast<void*>(buffer), length, offset);
+    }
+
+    uint64_t submitRead(int fd, void* buffer, size_t length, off_t offset) override {
+        return submit(IORING_OP_READ, fd, buffer, length, offset);
+    }
+
+    void wait(uint64_t ticket) override {
+        auto request = requests.find(ticket);
+        if (request == requests.end()) {
+            throw std::runtime_error("wait on unknown ticket " + std::to_string(ticket));
+        }
+        while (!request->second.done) {
+            reap();
+            if (!request->second.done) enter(0, 1);
+        }
+        Request finished = request->second;
+        requests.erase(request);
+        checkTransfer(finished.result, finished.length, finished.opcode == IORING_OP_WRITE ? "write" : "read");
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+private:
+    struct Request {
+        uint8_t opcode;
+        size_t length;
+        long result = 0;
+        bool done = false;
+    };
+
+    int ringFd;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingBytes = 0;
+    size_t cqRingBytes = 0;
+    size_t sqesBytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    io_uring_cqe* cqes;
+    unsigned cqMask;
+    unsigned cqEntries;
+    unsigned inFlight = 0;
+    uint64_t nextTicket = 1;
+    std::unordered_map<uint64_t, Request> requests;
+
+    void* mapRing(size_t bytes, off_t offset) {
+        void* ring = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        if (ring == MAP_FAILED) {
+            throw std::runtime_error(std::string("io_uring mmap failed: ") + std::strerror(errno));
+        }
+        return ring;
+    }
+
+    void mapRings(const io_uring_params& params) {
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) {
+            sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+        }
+        sqRing = mapRing(sqRingBytes, IORING_OFF_SQ_RING);
+        cqRing = singleMmap ? sqRing : mapRing(cqRingBytes, IORING_OFF_CQ_RING);
+        sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mapRing(sqesBytes, IORING_OFF_SQES));
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        cqEntries = params.cq_entries;
+    }
+
+    // IORING_REGISTER_PROBE arrived in 5.6 together with IORING_OP_READ and IORING_OP_WRITE, so a
+    // kernel that rejects the probe does not have them either.
+    void requireReadWrite() {
+        const unsigned probedOps = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) + probedOps * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, probedOps) < 0) {
+            throw std::runtime_error(std::string("io_uring opcode probe failed: ") + std::strerror(errno));
+        }
+        for (uint8_t opcode : {IORING_OP_READ, IORING_OP_WRITE}) {
+            if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+                throw std::runtime_error("io_uring does not support opcode " + std::to_string(opcode));
+            }
+        }
+    }
+
+    // Unmaps whatever is mapped and closes the ring.
+    void release() {
+        if (sqes) munmap(sqes, sqesBytes);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+        if (sqRing) munmap(sqRing, sqRingBytes);
+        close(ringFd);
+    }
+
+    void enter(unsigned toSubmit, unsigned minComplete) {
+        unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        while (syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0) < 0) {
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            }
+        }
+    }
+
+    void reap() {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            Request& request = requests[cqe.user_data];
+            request.result = cqe.res;
+            request.done = true;
+            --inFlight;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    uint64_t submit(uint8_t opcode, int fd, void* buffer, size_t length, off_t offset) {
+        // Keep completions from overflowing the completion queue.
+        while (inFlight >= std::min(sqEntries, cqEntries)) {
+            reap();
+            if (inFlight >= std::min(sqEntries, cqEntries)) enter(0, 1);
+        }
+
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.off = static_cast<uint64_t>(offset);
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = static_cast<uint32_t>(length);
+        uint64_t ticket = nextTicket++;
+        sqe.user_data = ticket;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        requests[ticket] = Request{opcode, length};
+        ++inFlight;
+        enter(1, 0);
+        return ticket;
+    }
+};
+
+// Fallback backend: a small pool of threads issuing blocking pread/pwrite calls.
+class ThreadPoolIO : public AsyncFileIO {
+public:
+    explicit ThreadPoolIO(int threads = 4) {
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPoolIO() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        pending.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    uint64_t submitWrite(int fd, const void* buffer, size_t length, off_t offset) override {
+        return submit(length, true, [=] {
+            size_t done = 0;
+            while (done < length) {
+                ssize_t n = pwrite(fd, static_cast<const char*>(buffer) + done, length - done, offset + done);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return n < 0 ? -static_cast<long>(errno) : static_cast<long>(done);
+                done += n;
+            }
+            return static_cast<long>(done);
+        });
+    }
+
+    uint64_t submitRead(int fd, void* buffer, size_t length, off_t offset) override {
+        return submit(length, false, [=] {
+            size_t done = 0;
+            while (done < length) {
+                ssize_t n = pread(fd, static_cast<char*>(buffer) + done, length - done, offset + done);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return n < 0 ? -static_cast<long>(errno) : static_cast<long>(done);
+                done += n;
+            }
+            return static_cast<long>(done);
+        });
+    }
+
+    void wait(uint64_t ticket) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto pending = requests.find(ticket);
+        if (pending == requests.end()) {
+            throw std::runtime_error("wait on unknown ticket " + std::to_string(ticket));
+        }
+        // Other threads may submit meanwhile; references survive a rehash, iterators do not.
+        const Request& done = pending->second;
+        finished.wait(lock, [&] { return done.done; });
+        Request request = done;
+        requests.erase(ticket);
+        lock.unlock();
+        checkTransfer(request.result, request.length, request.isWrite ? "pwrite" : "pread");
+    }
+
+    const char* name() const override { return "thread-pool"; }
+
+private:
+    struct Request {
+        size_t length = 0;
+        bool isWrite = false;
+        long result = 0;
+        bool done = false;
+    };
+
+    std::mutex mutex;
+    std::condition_variable pending;
+    std::condition_variable finished;
+    std::deque<std::pair<uint64_t, std::function<long()>>> queue;
+    std::unordered_map<uint64_t, Request> requests;
+    std::vector<std::thread> workers;
+    uint64_t nextTicket = 1;
+    bool stopping = false;
+
+    uint64_t submit(size_t length, bool isWrite, std::function<long()> transfer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t ticket = nextTicket++;
+        requests[ticket] = Request{length, isWrite};
+        queue.emplace_back(ticket, std::move(transfer));
+        pending.notify_one();
+        return ticket;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            pending.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            auto job = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            long result = job.second();
+            lock.lock();
+            requests[job.first].result = result;
+            requests[job.first].done = true;
+            finished.notify_all();
+        }
+    }
+};
+
+// io_uring when the kernel supports it for file reads and writes, the thread pool otherwise.
+inline std::unique_ptr<AsyncFileIO> createAsyncFileIO(bool preferIoUring = true) {
+    if (preferIoUring) {
+        try {
+            return std::make_unique<IoUringIO>();
+        } catch (const std::runtime_error&) {
+        }
+    }
+    return std::make_unique<ThreadPoolIO>();
+}
+
+// Part 2: Partition files
+
+template<typename T>
+size_t encodedSize(const Tuple<T>& tuple) {
+    if constexpr (std::is_same_v<T, std::string>) {
+        return 2 * sizeof(int) + sizeof(uint32_t) + tuple.C.size();
+    } else {
+        return 2 * sizeof(int) + sizeof(T);
+    }
+}
+
+template<typename T>
+void encodeTuple(const Tuple<T>& tuple, std::vector<char>& page) {
+    size_t at = page.size();
+    page.resize(at + encodedSize(tuple));
+    char* out = page.data() + at;
+    std::memcpy(out, &tuple.A, sizeof(int));
+    std::memcpy(out + sizeof(int), &tuple.B, sizeof(int));
+    out += 2 * sizeof(int);
+    if constexpr (std::is_same_v<T, std::string>) {
+        uint32_t length = static_cast<uint32_t>(tuple.C.size());
+        std::memcpy(out, &length, sizeof(length));
+        std::memcpy(out + sizeof(length), tuple.C.data(), length);
+    } else {
+        std::memcpy(out, &tuple.C, sizeof(T));
+    }
+}
+
+template<typename T>
+const char* decodeTuple(const char* in, Tuple<T>& tuple) {
+    std::memcpy(&tuple.A, in, sizeof(int));
+    std::memcpy(&tuple.B, in + sizeof(int), sizeof(int));
+    in += 2 * sizeof(int);
+    if constexpr (std::is_same_v<T, std::string>) {
+        uint32_t length;
+        std::memcpy(&length, in, sizeof(length));
+        tuple.C.assign(in + sizeof(length), length);
+        return in + sizeof(length) + length;
+    } else {
+        std::memcpy(&tuple.C, in, sizeof(T));
+        return in + sizeof(T);
+    }
+}
+
+// One relation's partitions in an unlinked temporary file. Each partition owns two page
+// buffers: while one is being written the other keeps accepting tuples.
+template<typename T>
+class PartitionFile {
+public:
+    PartitionFile(AsyncFileIO& io, int numPartitions, size_t pageBytes = PAGE_BYTES)
+        : io(io), pageBytes(pageBytes), partitions(numPartitions) {
+        const char* directory = std::getenv("TMPDIR");
+        std::string path = std::string(directory ? directory : "/tmp") + "/partition_XXXXXX";
+        fd = mkstemp(&path[0]);
+        if (fd < 0) {
+            throw std::runtime_error("mkstemp failed: " + std::string(std::strerror(errno)));
+        }
+        unlink(path.c_str());
+        for (auto& partition : partitions) {
+            for (auto& page : partition.pages) {
+                page.data.reserve(pageBytes);
+            }
+        }
+    }
+
+    PartitionFile(const PartitionFile&) = delete;
+    PartitionFile& operator=(const PartitionFile&) = delete;
+
+    ~PartitionFile() {
+        // Buffers must outlive every request that points into them.
+        for (auto& partition : partitions) {
+            for (auto& page : partition.pages) {
+                if (page.pending) {
+                    try { io.wait(page.ticket); } catch (const std::runtime_error&) {}
+                }
+            }
+        }
+        for (auto& prefetch : prefetches) {
+            for (uint64_t ticket : prefetch.second.tickets) {
+                try { io.wait(ticket); } catch (const std::runtime_error&) {}
+            }
+        }
+        close(fd);
+    }
+
+    void append(int index, const Tuple<T>& tuple) {
+        Partition& partition = partitions[index];
+        Page* page = &partition.pages[partition.active];
+        if (!page->data.empty() && page->data.size() + encodedSize(tuple) > pageBytes) {
+            page = &flip(index);
+        }
+        encodeTuple(tuple, page->data);
+        partition.tuples++;
+    }
+
+    // Writes every partially filled page and waits until all pages are on disk.
+    void finish() {
+        for (int i = 0; i < static_cast<int>(partitions.size()); ++i) {
+            if (!partitions[i].pages[partitions[i].active].data.empty()) {
+                flip(i);
+            }
+            for (auto& page : partitions[i].pages) {
+                settle(page);
+            }
+        }
+    }
+
+    // Starts reading every page of a partition into a staging buffer.
+    void prefetch(int index) {
+        if (index < 0 || index >= static_cast<int>(partitions.size()) || prefetches.count(index)) return;
+        Prefetch& prefetch = prefetches[index];
+        size_t total = 0;
+        for (const auto& extent : partitions[index].extents) {
+            total += extent.length;
+        }
+        prefetch.data.resize(total);
+        size_t at = 0;
+        for (const auto& extent : partitions[index].extents) {
+            prefetch.tickets.push_back(io.submitRead(fd, prefetch.data.data() + at, extent.length, extent.offset));
+            at += extent.length;
+            pagesRead++;
+            bytesRead += extent.length;
+        }
+    }
+
+    // Returns the tuples of a partition, waiting for (or issuing) its prefetch.
+    std::vector<Tuple<T>> take(int index) {
+        prefetch(index);
+        auto prefetch = prefetches.find(index);
+        // A ticket leaves the prefetch before it is waited on, so if a read fails the destructor
+        // only waits for the reads that are still in flight.
+        std::vector<uint64_t>& tickets = prefetch->second.tickets;
+        while (!tickets.empty()) {
+            uint64_t ticket = tickets.back();
+            tickets.pop_back();
+            io.wait(ticket);
+        }
+        std::vector<Tuple<T>> tuples(partitions[index].tuples);
+        const char* in = prefetch->second.data.data();
+        for (auto& tuple : tuples) {
+            in = decodeTuple(in, tuple);
+        }
+        prefetches.erase(prefetch);
+        return tuples;
+    }
+
+    size_t size(int index) const { return partitions[index].tuples; }
+
+    long long pagesWritten = 0;
+    long long bytesWritten = 0;
+    long long pagesRead = 0;
+    long long bytesRead = 0;
+
+private:
+    struct Page {
+        std::vector<char> data;
+        uint64_t ticket = 0;
+        bool pending = false;
+    };
+
+    struct Extent {
+        off_t offset;
+        size_t length;
+    };
+
+    struct Partition {
+        Page pages[2];
+        int active = 0;
+        size_t tuples = 0;
+        std::vector<Extent> extents;
+    };
+
+    struct Prefetch {
+        std::vector<char> data;
+        std::vector<uint64_t> tickets;
+    };
+
+    AsyncFileIO& io;
+    size_t pageBytes;
+    int fd;
+    off_t fileSize = 0;
+    std::vector<Partition> partitions;
+    std::map<int, Prefetch> prefetches;
+
+    void settle(Page& page) {
+        if (page.pending) {
+            page.pending = false;
+            io.wait(page.ticket);
+        }
+    }
+
+    // Submits the active page and switches to the other one once its previous write is done.
+    Page& flip(int index) {
+        Partition& partition = partitions[index];
+        Page& full = partition.pages[partition.active];
+        full.ticket = io.submitWrite(fd, full.data.data(), full.data.size(), fileSize);
+        full.pending = true;
+        partition.extents.push_back({fileSize, full.data.size()});
+        fileSize += full.data.size();
+        pagesWritten++;
+        bytesWritten += full.data.size();
+
+        partition.active ^= 1;
+        Page& next = partition.pages[partition.active];
+        settle(next);
+        next.data.clear();
+        return next;
+    }
+};
+
+// Part 3: Join Algorithm
+
+// Two-pass hash join whose partitions live in real files. Phase 1 matches twoPassJoin (S first,
+// Bloom filter on R) but pages are written asynchronously; Phase 2 reads partition i + 1 while
+// partition i is joined. Block counts in the profile are pages of `pageBytes`.
+template<typename T>
+std::vector<Tuple<T>> spillingJoin(std::vector<Tuple<T>>& R, std::vector<Tuple<T>>& S, JoinProfile& profile,
+                                   AsyncFileIO& io, bool useBloomFilter = true, size_t pageBytes = PAGE_BYTES) {
+    if (static_cast<int>(R.size() + S.size()) <= MEMORY_BLOCKS * BLOCK_SIZE) {
+        return twoPassJoin(R, S, profile, useBloomFilter);
+    }
+    profile = JoinProfile();
+    std::vector<Tuple<T>> output;
+    PartitionFile<T> filesR(io, MEMORY_BLOCKS, pageBytes);
+    PartitionFile<T> filesS(io, MEMORY_BLOCKS, pageBytes);
+
+    // Phase 1: Partitioning
+    auto start = std::chrono::steady_clock::now();
+    BlockedBloomFilter bloomFilter(useBloomFilter ? S.size() : 0);
+    for (const auto& tuple : S) {
+        if (useBloomFilter) {
+            bloomFilter.insert(tuple.B);
+        }
+        filesS.append(hashFunction(tuple.B), tuple);
+    }
+    for (const auto& tuple : R) {
+        if (useBloomFilter && !bloomFilter.mayContain(tuple.B)) {
+            profile.bloomFiltered++;
+            continue;
+        }
+        filesR.append(hashFunction(tuple.B), tuple);
+    }
+    filesS.finish();
+    filesR.finish();
+    profile.partitioning.blocksWritten = filesR.pagesWritten + filesS.pagesWritten;
+    profile.partitioning.bytesWritten = filesR.bytesWritten + filesS.bytesWritten;
+    profile.partitioning.wallMillis = elapsedMillis(start);
+
+    // Phase 2: Join
+    start = std::chrono::steady_clock::now();
+    filesS.prefetch(0);
+    filesR.prefetch(0);
+    for (int i = 0; i < MEMORY_BLOCKS; ++i) {
+        profile.partitionSizesR.push_back(filesR.size(i));
+        profile.partitionSizesS.push_back(filesS.size(i));
+        std::vector<Tuple<T>> partitionS = filesS.take(i);
+        std::vector<Tuple<T>> partitionR = filesR.take(i);
+        filesS.prefetch(i + 1);
+        filesR.prefetch(i + 1);
+        joinPartition(partitionR, partitionS, output, profile);
+    }
+    profile.join.blocksRead = filesR.pagesRead + filesS.pagesRead;
+    profile.join.bytesRead = filesR.bytesRead + filesS.bytesRead;
+    profile.join.wallMillis = elapsedMillis(start);
+    profile.outputTuples = output.size();
+
+    return output;
+}
+
+#endif
@@ -0,0 +1,280 @@
+// sort_merge_join.h
+#ifndef SORT_MERGE_JOIN_H
+#define SORT_MERGE_JOIN_H
+
+#include <functional>
+#include <queue>
+#include <memory>
+#include "hashing_based_join.h"
+#include "../BPlusTree/b_plus_tree.h"
+
+// Sort-merge join over inputs that produce tuples in ascending B order. Inputs that are not
+// sorted go through an external merge sort that uses the same memory budget and
+// virtual disk as twoPassJoin; sorted inputs and B+ tree leaf-chain scans skip it entirely.
+// The output of a merge join is sorted on B.
+
+// Part 1: Sorted Inputs
+
+template<typename T>
+class SortedInput {
+public:
+    virtual ~SortedInput() = default;
+    // Stores the next tuple in ascending B order; returns false once the input is exhausted.
+    virtual bool next(Tuple<T>& tuple) = 0;
+};
+
+// A relation already sorted on B.
+template<typename T>
+class PresortedInput : public SortedInput<T> {
+public:
+    explicit PresortedInput(const std::vector<Tuple<T>>& relation) : relation(relation) {}
+
+    bool next(Tuple<T>& tuple) override {
+        if (position == relation.size()) return false;
+        tuple = relation[position++];
+        return true;
+    }
+
+private:
+    const std::vector<Tuple<T>>& relation;
+    size_t position = 0;
+};
+
+// Leaf-chain scan of a B+ tree keyed on B whose values are positions in `rows`. Like the index
+// nested-loop join, it charges one block read per internal node on the descent to the first leaf
+// and per leaf entered.
+template<typename T>
+class IndexScanInput : public SortedInput<T> {
+public:
+    IndexScanInput(const BPlusTree& index, const std::vector<Tuple<T>>& rows, PhaseStats& stats)
+        : cursor(index.begin()), rows(rows), stats(&stats) {
+        stats.blocksRead += std::max(0, index.height() - 1);
+        charge();
+    }
+
+    bool next(Tuple<T>& tuple) override {
+        if (!cursor.valid()) return false;
+        tuple = rows[cursor.value()];
+        cursor.next();
+        charge();
+        return true;
+    }
+
+private:
+    LeafCursor cursor;
+    const std::vector<Tuple<T>>& rows;
+    PhaseStats* stats;
+    int chargedLeaves = 0;
+
+    void charge() {
+        stats->blocksRead += cursor.leaves_visited() - chargedLeaves;
+        chargedLeaves = cursor.leaves_visited();
+    }
+};
+
+// One sorted run on the virtual disk, read back one block at a time.
+template<typename T>
+class RunReader {
+public:
+    RunReader(std::vector<Tuple<T>>& run, PhaseStats& stats) : run(&run), stats(&stats) {}
+
+    bool next(Tuple<T>& tuple) {
+        if (position == memory.size()) {
+            memory.clear();
+            position = 0;
+            if (nextBlock * BLOCK_SIZE >= static_cast<int>(run->size())) return false;
+            readBlock(memory, *run, nextBlock++);
+            stats->blocksRead++;
+            for (const auto& read : memory) {
+                stats->bytesRead += tupleBytes(read);
+            }
+        }
+        tuple = memory[position++];
+        return true;
+    }
+
+private:
+    std::vector<Tuple<T>>* run;
+    PhaseStats* stats;
+    std::vector<Tuple<T>> memory;
+    size_t position = 0;
+    int nextBlock = 0;
+};
+
+// K-way merge of sorted runs through a min-heap on B.
+template<typename T>
+class RunMerger {
+public:
+    RunMerger(std::vector<std::vector<Tuple<T>>>& runs, size_t first, size_t last, PhaseStats& stats) {
+        for (size_t i = first; i < last; ++i) {
+            readers.emplace_back(runs[i], stats);
+        }
+        heads.resize(readers.size());
+        for (size_t i = 0; i < readers.size(); ++i) {
+            if (readers[i].next(heads[i])) heap.push({heads[i].B, i});
+        }
+    }
+
+    bool next(Tuple<T>& tuple) {
+        if (heap.empty()) return false;
+        size_t reader = heap.top().second;
+        heap.pop();
+        tuple = std::move(heads[reader]);
+        if (readers[reader].next(heads[reader])) heap.push({heads[reader].B, reader});
+        return true;
+    }
+
+private:
+    std::vector<RunReader<T>> readers;
+    std::vector<Tuple<T>> heads;
+    std::priority_queue<std::pair<int, size_t>, std::vector<std::pair<int, size_t>>, std::greater<>> heap;
+};
+
+// External merge sort on B. Run generation sorts MEMORY_BLOCKS * BLOCK_SIZE tuples at a time and
+// writes them to the virtual disk; merge passes combine at most `fanIn` runs until `fanIn` remain,
+// and those are merged on the fly as the input is consumed.
+template<typename T>
+class ExternalSortInput : public SortedInput<T> {
+public:
+    ExternalSortInput(const std::vector<Tuple<T>>& relation, int fanIn, PhaseStats& sortStats, PhaseStats& mergeStats) {
+        const size_t memoryTuples = MEMORY_BLOCKS * BLOCK_SIZE;
+        auto byB = [](const Tuple<T>& a, const Tuple<T>& b) { return a.B < b.B; };
+
+        for (size_t start = 0; start < relation.size(); start += memoryTuples) {
+            std::vector<Tuple<T>> memory(relation.begin() + start,
+                                         relation.begin() + std::min(relation.size(), start + memoryTuples));
+            std::sort(memory.begin(), memory.end(), byB);
+            runs.emplace_back();
+            writeRun(memory, runs.back(), sortStats);
+        }
+
+        fanIn = std::max(2, fanIn);
+        while (static_cast<int>(runs.size()) > fanIn) {
+            std::vector<std::vector<Tuple<T>>> merged;
+            for (size_t first = 0; first < runs.size(); first += fanIn) {
+                RunMerger<T> merger(runs, first, std::min(runs.size(), first + fanIn), sortStats);
+                std::vector<Tuple<T>> output;
+                merged.emplace_back();
+                Tuple<T> tuple;
+                while (merger.next(tuple)) {
+                    output.push_back(std::move(tuple));
+                    if (output.size() == BLOCK_SIZE) flushBlock(output, merged.back(), sortStats);
+                }
+                if (!output.empty()) flushBlock(output, merged.back(), sortStats);
+            }
+            runs.swap(merged);
+        }
+
+        merger = std::make_unique<RunMerger<T>>(runs, 0, runs.size(), mergeStats);
+    }
+
+    bool next(Tuple<T>& tuple) override {
+        return merger->next(tuple);
+    }
+
+    size_t runCount() const { return runs.size(); }
+
+private:
+    std::vector<std::vector<Tuple<T>>> runs;
+    std::unique_ptr<RunMerger<T>> merger;
+
+    static void flushBlock(std::vector<Tuple<T>>& block, std::vector<Tuple<T>>& run, PhaseStats& stats) {
+        for (const auto& tuple : block) {
+            stats.bytesWritten += tupleBytes(tuple);
+        }
+        writeBlock(block, run);
+        stats.blocksWritten++;
+    }
+
+    static void writeRun(std::vector<Tuple<T>>& sorted, std::vector<Tuple<T>>& run, PhaseStats& stats) {
+        std::vector<Tuple<T>> block;
+        for (auto& tuple : sorted) {
+            block.push_back(std::move(tuple));
+            if (block.size() == BLOCK_SIZE) flushBlock(block, run, stats);
+        }
+        if (!block.empty()) flushBlock(block, run, stats);
+    }
+};
+
+// Part 2: Join Algorithm
+
+// Merges two inputs sorted on B. All S tuples of one B-value are buffered and joined with every
+// R tuple of that value, so the output is sorted on B.
+template<typename T>
+void mergeJoin(SortedInput<T>& R, SortedInput<T>& S, std::vector<Tuple<T>>& output, JoinProfile& profile) {
+    Tuple<T> r, s;
+    bool hasR = R.next(r);
+    bool hasS = S.next(s);
+    std::vector<Tuple<T>> group;
+
+    while (hasR && hasS) {
+        if (r.B < s.B) {
+            profile.probes++;
+            hasR = R.next(r);
+        } else if (s.B < r.B) {
+            hasS = S.next(s);
+        } else {
+            int key = s.B;
+            group.clear();
+            while (hasS && s.B == key) {
+                group.push_back(s);
+                hasS = S.next(s);
+            }
+            while (hasR && r.B == key) {
+                profile.probes++;
+                profile.probeHits++;
+                for (const auto& s_tuple : group) {
+                    output.push_back({r.A, r.B, s_tuple.C});
+                }
+                hasR = R.next(r);
+            }
+        }
+    }
+}
+
+// What the planner knows about one join input. `indexOnB`, if set, maps each B-value to the
+// position of its tuple in `*relation`.
+template<typename T>
+struct JoinInput {
+    std::vector<Tuple<T>>* relation;
+    bool sortedOnB = false;
+    const BPlusTree* indexOnB = nullptr;
+
+    bool ordered() const { return sortedOnB || indexOnB != nullptr; }
+};
+
+template<typename T>
+std::unique_ptr<SortedInput<T>> sortedInput(const JoinInput<T>& input, int fanIn, JoinProfile& profile) {
+    if (input.indexOnB) return std::make_unique<IndexScanInput<T>>(*input.indexOnB, *input.relation, profile.join);
+    if (input.sortedOnB) return std::make_unique<PresortedInput<T>>(*input.relation);
+    return std::make_unique<ExternalSortInput<T>>(*input.relation, fanIn, profile.partitioning, profile.join);
+}
+
+// Sort-merge join. Indexed inputs are scanned along the leaf chain, sorted ones are consumed
+// directly and the others are externally sorted, each getting half of the memory blocks as
+// merge buffers. In the profile, `partitioning` holds run generation and merge passes and
+// `join` the final merge, including the leaf-chain scans of indexed inputs.
+template<typename T>
+std::vector<Tuple<T>> sortMergeJoin(const JoinInput<T>& R, const JoinInput<T>& S, JoinProfile& profile) {
+    profile = JoinProfile();
+    std::vector<Tuple<T>> output;
+    int fanIn = (MEMORY_BLOCKS - 1) / 2;
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<SortedInput<T>> inputR = sortedInput(R, fanIn, profile);
+    std::unique_ptr<SortedInput<T>> inputS = sortedInput(S, fanIn, profile);
+    profile.partitioning.wallMillis = elapsedMillis(start);
+
+    start = std::chrono::steady_clock::now();
+    mergeJoin(*inputR, *inputS, output, profile);
+    profile.join.wallMillis = elapsedMillis(start);
+    profile.outputTuples = output.size();
+    return output;
+}
+
+template<typename T>
+std::vector<Tuple<T>> sortMergeJoin(std::vector<Tuple<T>>& R, std::vector<Tuple<T>>& S, JoinProfile& profile) {
+    return sortMergeJoin(JoinInput<T>{&R}, JoinInput<T>{&S}, profile);
+}
+
+#endif